@@ -11,6 +11,7 @@ namespace CommaApi2 {
 
 const std::string BASE_URL = util::getenv("API_HOST", "https://api.commadotai.com").c_str();
 std::string create_token(bool use_jwt, const json& payloads = {}, int expiry = 3600);
-std::string httpGet(const std::string& url, long* response_code = nullptr);
+// timeout_ms limits the whole request, 0 waits indefinitely
+std::string httpGet(const std::string& url, long* response_code = nullptr, long timeout_ms = 0);
 
 }  // namespace CommaApi2
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <map>
+#include <string>
+
+#include "route.h"
+
+// Resolve the log file of every segment in the route from the best available source.
+// internal, openpilotci, comma_api, car_segments, testing_closet and local directories
+// are probed concurrently and their answers merged, a full log beating a qlog and then the
+// source order. A closed segment range returns as soon as every segment is found, an
+// open-ended one once every source answered, since no single source knows the route's end.
+std::map<int, std::string> resolveAutoSource(const RouteIdentifier &route, const std::string &data_dir = {});
@@ -1,27 +1,67 @@
 #pragma once
 
+#include <atomic>
 #include <condition_variable>
+#include <functional>
 #include <memory>
 #include <mutex>
-#include <set>
+#include <string>
 #include <tuple>
 #include <utility>
+#include <vector>
 
 #include "msgq/visionipc/visionipc_server.h"
 #include "config.h"
 #include "framereader.h"
 #include "logreader.h"
+#include "mpmc_queue.h"
+#include "queue_monitor.h"
 
 std::tuple<size_t, size_t, size_t> get_nv12_info(int width, int height);
 
 class CameraServer {
 public:
-  CameraServer(std::pair<int, int> camera_size[MAX_CAMERAS] = nullptr);
+  struct Options {
+    int decode_ahead = DEFAULT_DECODE_AHEAD;
+    int queue_size = DEFAULT_FRAME_QUEUE;
+    FrameQueuePolicy policy = FrameQueuePolicy::DropOldest;
+    // Frames are decoded once and also copied to a VisionIpc server in each fan-out prefix
+    std::vector<std::string> fanout_prefixes;
+    // Playback speed. When set, a camera whose decoding falls behind it only decodes key frames.
+    const std::atomic<float> *speed = nullptr;
+  };
+
+  CameraServer(std::pair<int, int> camera_size[MAX_CAMERAS], const Options &options);
   ~CameraServer();
-  void pushFrame(CameraType type, FrameReader* fr, const Event *event);
+  // Queue a frame for its camera thread, only blocks with FrameQueuePolicy::Block. Not thread
+  // safe: a resolution change restarts the VisionIpc servers of every camera from here.
+  // on_sent is called from the camera thread once the frame is sent. If it is dropped or
+  // skipped (decoding only key frames, no subscribers), it is called with the next frame sent.
+  void pushFrame(CameraType type, std::shared_ptr<FrameReader> fr, const Event *event,
+                 std::function<void()> on_sent = nullptr);
+  // Wait until every queued frame is sent or dropped
   void waitForSent();
+  // Drop the queued frames without decoding them, then wait for the ones being sent
+  void discardQueued();
+  // Called from the camera threads after each frame is sent. Set before the first pushFrame.
+  void setFrameCallback(std::function<void(CameraType, const VisionBuf *, const Event *)> callback) {
+    frame_callback_ = callback;
+  }
 
 protected:
+  // A frame decoded ahead, kept in slot frame_id % ring size
+  struct DecodedFrame {
+    std::shared_ptr<FrameReader> fr;
+    uint32_t frame_id = 0;
+    VisionBuf *buf = nullptr;  // nullptr if decoding failed
+  };
+
+  struct FrameRequest {
+    std::shared_ptr<FrameReader> fr;
+    const Event *event = nullptr;
+    std::function<void()> on_sent;
+  };
+
   struct Camera {
     CameraType type;
     VisionStreamType stream_type;
@@ -29,22 +69,63 @@ protected:
     int height = 0;
     std::thread thread;
     std::mutex mutex;
-    std::condition_variable cv_ready;  // Producer waits: slot is free
-    std::condition_variable cv_sent;   // Consumer signals: frame sent
-    bool pending = false;
+    std::condition_variable cv_ready;  // Consumer waits: frame queued
+    std::condition_variable cv_sent;   // Producer waits: frame sent or dropped
+    bool sleeping = false;  // Guarded by mutex
     bool terminate = false;
-    FrameReader* fr = nullptr;
-    const Event* event = nullptr;
-    std::set<VisionBuf *> cached_buf;
+    std::unique_ptr<MPMCQueue<FrameRequest>> queue;
+    std::atomic<uint64_t> pushed = 0;
+    std::atomic<uint64_t> done = 0;  // Sent or dropped
+    std::atomic<uint64_t> dropped = 0;
+    std::atomic<uint64_t> skipped = 0;  // Not decoded, no client was subscribed
+    std::atomic<uint64_t> degraded = 0;  // Not decoded, only key frames were decoded
+
+    // Adaptive degradation. decode_ms is the average time to decode a frame in sequence,
+    // written by the decode thread. Guarded by mutex, the rest is used by the camera thread.
+    bool keyframes_only = false;
+    double decode_ms = 0;
+    int decode_samples = 0;
+    double frame_interval_ms = 0;  // Average log time between frames
+    uint64_t last_frame_time = 0;
+    double degraded_at = 0;
+    bool probing = false;  // Trying full frame rate again
+
+    // Reader state of the stream's endpoint in each prefix, empty if it can not be observed.
+    // Used by the camera thread, replaced only while the frame queue is drained.
+    std::vector<std::unique_ptr<QueueMonitor>> monitors;
+    bool subscribed = true;
+
+    // The decode thread fills the ring with the requested frame and the ones following it,
+    // the camera thread takes them from their slot. Guarded by mutex.
+    std::thread decode_thread;
+    std::condition_variable cv_decode;   // Decoder waits: new request
+    std::condition_variable cv_decoded;  // Camera thread waits: requested frame is ready
+    std::vector<DecodedFrame> ring;
+    std::shared_ptr<FrameReader> request_fr;
+    int request_idx = 0;  // Index of the requested frame in its segment's video
+    uint32_t request_frame_id = 0;
+    bool decoding = false;
   };
   void startVipcServer();
+  void createBuffers(VisionIpcServer *server);
+  void sendFanout(Camera &cam, const VisionBuf *yuv, VisionIpcBufExtra *extra);
   void cameraThread(Camera &cam);
-  VisionBuf *getFrame(Camera &cam, FrameReader *fr, int32_t segment_id, uint32_t frame_id);
+  void decodeThread(Camera &cam);
+  VisionBuf *getFrame(Camera &cam, const std::shared_ptr<FrameReader> &fr, int idx, uint32_t frame_id);
+  void releaseStaleFrames(Camera &cam, const std::shared_ptr<FrameReader> &fr);
+  void resetDecodeAhead(Camera &cam);
+  void dropFrame(Camera &cam);
+  void openMonitors(Camera &cam);
+  bool hasSubscribers(Camera &cam);
+  void updateDecodeMode(Camera &cam, uint64_t mono_time);
 
   Camera cameras_[MAX_CAMERAS] = {
       {.type = RoadCam, .stream_type = VISION_STREAM_ROAD},
       {.type = DriverCam, .stream_type = VISION_STREAM_DRIVER},
       {.type = WideRoadCam, .stream_type = VISION_STREAM_WIDE_ROAD},
   };
+  const Options options_;
   std::unique_ptr<VisionIpcServer> vipc_server_;
+  std::vector<std::unique_ptr<VisionIpcServer>> fanout_servers_;
+  std::function<void(CameraType, const VisionBuf *, const Event *)> frame_callback_ = nullptr;
 };
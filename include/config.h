@@ -1,11 +1,19 @@
 #pragma once
 
+#include <map>
 #include <set>
 #include <string>
+#include <vector>
 
 #define DEMO_ROUTE "a2a0ccea32023010|2023-07-27--13-01-19"
 
 constexpr int MIN_SEGMENTS_CACHE = 5;
+constexpr size_t DEFAULT_SEGMENT_MEMORY_ESTIMATE = 64 * 1024 * 1024;
+constexpr size_t DEFAULT_WARM_CACHE_MEMORY = 256 * 1024 * 1024;
+constexpr int DEFAULT_PUBLISH_BATCH_US = 1000;
+constexpr int DEFAULT_DECODE_AHEAD = 4;
+constexpr int DEFAULT_FRAME_QUEUE = 4;
+constexpr size_t DEFAULT_EVENT_RING_SIZE = 64 * 1024 * 1024;
 constexpr size_t DEFAULT_CHUNK_SIZE = 20 * 1024 * 1024;
 constexpr int MAX_DOWNLOAD_PARTS = 4;
 constexpr int MAX_RETRIES = 3;
@@ -19,6 +27,13 @@ enum CameraType {
 const CameraType ALL_CAMERAS[] = {RoadCam, DriverCam, WideRoadCam};
 const int MAX_CAMERAS = std::size(ALL_CAMERAS);
 
+// What the stream does when a camera's frame queue is full
+enum class FrameQueuePolicy {
+  DropOldest,  // Drop the oldest queued frame
+  Block,       // Wait for the camera thread
+  Latest,      // Keep only the newest frame, coalescing anything queued
+};
+
 enum REPLAY_FLAGS {
   REPLAY_FLAG_NONE = 0x0000,
   REPLAY_FLAG_DCAM = 0x0002,
@@ -30,17 +45,37 @@ enum REPLAY_FLAGS {
   REPLAY_FLAG_NO_VIPC = 0x0400,
   REPLAY_FLAG_ALL_SERVICES = 0x0800,
   REPLAY_FLAG_LOW_MEMORY = 0x1000,
+  REPLAY_FLAG_MAX_THROUGHPUT = 0x2000,
+  REPLAY_FLAG_LOCKSTEP = 0x4000,
+  REPLAY_FLAG_NO_MSGQ = 0x8000,
+  REPLAY_FLAG_NO_FRAME_SKIP = 0x10000,
 };
 
 struct ReplayConfig {
   std::string route;
+  std::string playlist;  // file with one route per line, "-" for stdin
   std::set<std::string> allow;
   std::set<std::string> block;
+  std::set<std::string> no_decimate;         // services that are never decimated, "all" to disable
+  std::map<std::string, float> rate_limits;  // publish rate caps in Hz, default to services.py
   std::string data_dir;
   std::string prefix;
+  std::vector<std::string> fanout_prefixes;  // extra OPENPILOT_PREFIX namespaces published into
+  std::string event_ring;  // shm ring carrying all published events, empty to disable
+  size_t event_ring_size = DEFAULT_EVENT_RING_SIZE;
+  std::vector<std::string> plugins;  // "path[:args]" of in-process consumers
   uint32_t flags = REPLAY_FLAG_NONE;
   bool auto_source = false;
   int start_seconds = 0;
   int cache_segments = MIN_SEGMENTS_CACHE;
+  int worker_threads = 0;
+  int publisher_threads = 0;  // 0 to publish from the stream thread
+  int decode_ahead = DEFAULT_DECODE_AHEAD;  // frames decoded ahead of the stream per camera
+  int frame_queue = DEFAULT_FRAME_QUEUE;    // frames queued per camera before frame_policy applies
+  FrameQueuePolicy frame_policy = FrameQueuePolicy::DropOldest;
+  size_t cache_memory = 0;  // bytes, 0 to size the cache by cache_segments
+  size_t mem_reserve = 0;   // bytes of MemAvailable to keep free
+  size_t warm_cache_memory = DEFAULT_WARM_CACHE_MEMORY;  // compressed logs of evicted segments
   float playback_speed = 1.0f;
+  int publish_batch_us = DEFAULT_PUBLISH_BATCH_US;  // events due within this window are published together
 };
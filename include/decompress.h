@@ -7,3 +7,4 @@ std::string decompressBZ2(const std::string &in, std::atomic<bool> *abort = null
 std::string decompressBZ2(const std::byte *in, size_t in_size, std::atomic<bool> *abort = nullptr);
 std::string decompressZST(const std::string &in, std::atomic<bool> *abort = nullptr);
 std::string decompressZST(const std::byte *in, size_t in_size, std::atomic<bool> *abort = nullptr);
+std::string compressZST(const std::byte *in, size_t in_size, int level = 1);
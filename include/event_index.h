@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vector>
+
+#include "logreader.h"
+
+// Time-ordered view over the events of the loaded segments. Each segment contributes an
+// immutable, already sorted chunk, and a Cursor merges the chunks lazily while walking,
+// so adding or dropping a segment costs O(chunks) instead of copying every event.
+class EventIndex {
+public:
+  struct Chunk {
+    int seg_num;
+    const Event *begin;
+    const Event *end;
+  };
+
+  class Cursor {
+  public:
+    Cursor() = default;
+    inline bool atEnd() const { return current_ == nullptr; }
+    inline const Event &operator*() const { return *current_; }
+    inline const Event *operator->() const { return current_; }
+    Cursor &operator++();
+
+  private:
+    friend class EventIndex;
+    Cursor(const std::vector<Chunk> *chunks, std::vector<const Event *> &&positions);
+    void selectNext();
+
+    const std::vector<Chunk> *chunks_ = nullptr;
+    std::vector<const Event *> positions_;  // next unvisited event of each chunk
+    size_t first_live_ = 0;                 // chunks before it are exhausted
+    size_t current_chunk_ = 0;
+    const Event *current_ = nullptr;
+  };
+
+  void addChunk(int seg_num, const Event *begin, const Event *end);
+  Cursor begin() const;
+  Cursor upperBound(const Event &event) const;  // first event ordered after `event`
+  inline size_t size() const { return size_; }
+  inline bool empty() const { return size_ == 0; }
+  inline const std::vector<Chunk> &chunks() const { return chunks_; }
+
+private:
+  std::vector<Chunk> chunks_;  // ordered by their first event
+  size_t size_ = 0;
+};
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "logreader.h"
+
+// One large shared memory ring carrying the events of all services, for consumers that
+// subscribe to everything. A single writer appends records (which, mono_time, sequence
+// number and the capnp message) and publishes them by advancing one counter; readers keep
+// their own cursor and read the messages in place. Before it touches any bytes the writer
+// advances a reservation to the end of the record, and readers validate what they copied
+// against it. Records never wrap around the end of the ring, the writer pads the tail
+// instead. The ring lives in /dev/shm/[prefix/]<name>.
+namespace event_ring {
+
+constexpr uint64_t MAGIC = 0x474e495254504c52;  // "RLPTRING"
+constexpr uint32_t VERSION = 2;
+constexpr uint16_t PADDING = 0xffff;
+
+struct Header {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t capacity;  // bytes of record data, a power of two
+  alignas(64) std::atomic<uint64_t> write_offset;  // end of the committed records, never wraps
+  std::atomic<uint64_t> write_seq;                 // number of committed records
+  std::atomic<uint64_t> reserve_offset;            // end of the bytes being written, >= write_offset
+};
+
+struct RecordHeader {
+  uint32_t size;  // message bytes
+  uint16_t which;
+  uint16_t reserved;
+  uint64_t mono_time;
+  uint64_t seq;
+};
+
+std::string path(const std::string &name);
+
+}  // namespace event_ring
+
+class EventRingWriter {
+public:
+  EventRingWriter(const std::string &name, size_t capacity);
+  ~EventRingWriter();
+  inline bool isOpen() const { return header_ != nullptr; }
+  bool write(const Event &e);
+
+private:
+  std::string path_;
+  event_ring::Header *header_ = nullptr;
+  char *data_ = nullptr;
+  size_t map_size_ = 0;
+  uint64_t capacity_ = 0;
+  uint64_t offset_ = 0;
+  uint64_t seq_ = 0;
+};
+
+class EventRingReader {
+public:
+  struct View {
+    uint16_t which;
+    uint64_t mono_time;
+    uint64_t seq;
+    kj::ArrayPtr<const capnp::word> data;
+    uint64_t pos;
+  };
+
+  ~EventRingReader();
+  bool open(const std::string &name);
+  // The next committed event, or false once the reader has caught up. The view points
+  // into the ring and stays valid until the writer laps it, check valid() after using it.
+  bool next(View &view);
+  inline bool valid(const View &view) const { return valid(view.pos); }
+  // Events overwritten before this reader got to them
+  inline uint64_t lost() const { return lost_; }
+
+private:
+  // Nothing from pos on was overwritten. The fence orders the reads of the record before the
+  // reservation is loaded, it pairs with the release fence after the writer's reservation.
+  inline bool valid(uint64_t pos) const {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return header_->reserve_offset.load(std::memory_order_relaxed) - pos <= capacity_;
+  }
+  void resync();
+
+  const event_ring::Header *header_ = nullptr;
+  const char *data_ = nullptr;
+  size_t map_size_ = 0;
+  uint64_t capacity_ = 0;
+  uint64_t pos_ = 0;
+  uint64_t last_seq_ = 0;
+  uint64_t lost_ = 0;
+};
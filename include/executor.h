@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+enum class TaskPriority { High = 0, Normal, Low, Count };
+
+class TaskGroup;
+
+// A bounded pool of worker threads shared by all loaders. Each worker owns a deque per
+// priority; it runs its own tasks front-first and steals from the back of other workers
+// when idle. Higher priority tasks are always taken before lower ones.
+class TaskExecutor {
+public:
+  explicit TaskExecutor(int num_threads);
+  ~TaskExecutor();
+  static TaskExecutor &instance();
+  // Must be called before the first call to instance()
+  static void setDefaultThreadCount(int n);
+  inline int threadCount() const { return workers_.size(); }
+
+private:
+  friend class TaskGroup;
+  struct Task {
+    std::function<void()> fn;
+    TaskGroup *group;
+  };
+  struct Worker {
+    std::mutex mutex;
+    std::deque<Task> queues[(int)TaskPriority::Count];
+    std::thread thread;
+  };
+
+  void submit(Task task, TaskPriority priority);
+  size_t purge(TaskGroup *group);
+  bool popTask(int worker_id, Task &task);
+  void workerThread(int worker_id);
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::mutex sleep_mutex_;
+  std::condition_variable sleep_cv_;
+  std::atomic<size_t> queued_ = 0;
+  std::atomic<size_t> next_worker_ = 0;
+  std::atomic<bool> exit_ = false;
+  inline static int default_thread_count_ = 0;
+};
+
+// A set of related tasks that can be cancelled together. Cancelling drops the tasks that
+// have not started yet and raises the flag returned by cancelFlag(), which running tasks
+// poll cooperatively (it is passed down as the `abort` argument of the loaders).
+class TaskGroup {
+public:
+  TaskGroup(TaskExecutor &executor = TaskExecutor::instance()) : executor_(executor) {}
+  ~TaskGroup();
+  void submit(std::function<void()> fn, TaskPriority priority = TaskPriority::Normal);
+  void cancel();
+  void wait();
+  inline bool cancelled() const { return cancelled_; }
+  inline std::atomic<bool> *cancelFlag() { return &cancelled_; }
+
+private:
+  friend class TaskExecutor;
+  void finished(size_t count = 1);
+
+  TaskExecutor &executor_;
+  std::atomic<bool> cancelled_ = false;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  size_t pending_ = 0;
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+
+// msgq, VisionIpc and Params resolve their paths from OPENPILOT_PREFIX, which is only set at
+// startup: switching it while other threads read the environment is a data race. Fan-out
+// namespaces are addressed explicitly instead.
+
+// msgq endpoint of `name` in the namespace of prefix, relative to this process's msgq directory
+std::string fanoutEndpoint(const std::string &prefix, const std::string &name);
+
+// Name of the VisionIpc server this process runs for prefix. FanoutPrefix links the
+// namespace's "camerad" socket and buffer queues to it.
+std::string fanoutVipcName(const std::string &prefix);
+
+// Write a param into the namespace of prefix, same as Params::put()
+bool putFanoutParam(const std::string &prefix, const std::string &key, const std::string &value);
+
+// An extra OPENPILOT_PREFIX namespace that the same stream is published into. Must be created
+// before any other thread runs. Creates the msgq directory and the links to the fan-out
+// VisionIpc server, and removes them and the namespace's params again on destruction.
+class FanoutPrefix {
+public:
+  FanoutPrefix(const std::string &prefix);
+  ~FanoutPrefix();
+  inline const std::string &prefix() const { return prefix_; }
+
+private:
+  std::string prefix_;
+  std::string msgq_path_;
+  std::string param_path_;
+  std::string vipc_path_;
+};
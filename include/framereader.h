@@ -29,6 +29,12 @@ public:
   bool loadFromFile(CameraType type, const std::string &file, bool no_hw_decoder = false, std::atomic<bool> *abort = nullptr);
   bool get(int idx, VisionBuf *buf);
   size_t getFrameCount() const { return packets_info.size(); }
+  size_t memoryUsage() const;
+  bool isKeyFrame(int idx) const;
+  // Index of the key frame starting the GOP of frame idx
+  int keyFrameIndex(int idx) const;
+  // Unique for the lifetime of the process, unlike the reader's address
+  inline uint64_t id() const { return id_; }
 
   int width = 0, height = 0;
 
@@ -41,6 +47,11 @@ public:
     int64_t pos;
   };
   std::vector<PacketInfo> packets_info;
+
+private:
+  bool openInput(const std::string &file);
+
+  const uint64_t id_;
 };
 
 
@@ -50,6 +61,12 @@ public:
   virtual bool open(AVCodecParameters *codecpar, bool hw_decoder) = 0;
   virtual bool decode(FrameReader *reader, int idx, VisionBuf *buf) = 0;
   int width = 0, height = 0;
+
+protected:
+  // Decoders are shared by the readers of a camera. Returns the frame to start decoding at
+  // for idx, and whether the demuxer must seek there and the decoder be flushed.
+  std::pair<int, bool> startFrame(FrameReader *reader, int idx);
+  uint64_t last_reader_ = 0;  // id() of the reader decoded last, 0 for none
 };
 
 class FFmpegVideoDecoder : public VideoDecoder {
@@ -1,10 +1,12 @@
 #pragma once
 
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "cereal/gen/cpp/log.capnp.h"
 #include "config.h"
+#include "metrics.h"
 #include "util.h"
 
 class Event {
@@ -22,13 +24,33 @@ public:
   int32_t eidx_segnum;
 };
 
+// A compact copy of the parsed events: the message data zstd-compressed into one blob plus
+// the sorted index, so a LogReader can be restored without decompressing and parsing the log.
+struct CompressedLog {
+  struct Entry {
+    uint64_t mono_time;
+    cereal::Event::Which which;
+    int32_t eidx_segnum;
+    uint32_t offset;  // in words
+    uint32_t size;    // in words
+  };
+  std::string data;
+  size_t raw_size = 0;
+  std::vector<Entry> index;
+  size_t memoryUsage() const { return data.capacity() + index.capacity() * sizeof(Entry); }
+};
+
 class LogReader {
 public:
   LogReader(const std::vector<bool> &filters = {}) { filters_ = filters; }
   bool load(const std::string &url, bool low_memory = false, std::atomic<bool> *abort = nullptr,
             bool local_cache = false, int chunk_size = DEFAULT_CHUNK_SIZE, int retries = MAX_RETRIES);
   bool load(const char *data, size_t size, bool low_memory, std::atomic<bool> *abort = nullptr);
+  bool load(const CompressedLog &log, std::atomic<bool> *abort = nullptr);
+  std::unique_ptr<CompressedLog> compress(std::atomic<bool> *abort = nullptr) const;
+  size_t memoryUsage() const;
   std::vector<Event> events;
+  LoadTimings timings;
 
 private:
   void migrateOldEvents();
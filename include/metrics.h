@@ -0,0 +1,88 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Lock-free histogram of latencies in milliseconds. Buckets are logarithmic with four
+// steps per power of two from 1us, so percentiles are accurate to within ~20%.
+class LatencyHistogram {
+public:
+  void record(double ms);
+  double percentile(double p) const;
+  inline uint64_t count() const { return count_; }
+  inline double max() const { return max_us_ / 1000.0; }
+  std::string summary() const;
+
+private:
+  static constexpr int STEPS_PER_OCTAVE = 4;
+  static constexpr int BUCKETS = 32 * STEPS_PER_OCTAVE;
+  std::array<std::atomic<uint64_t>, BUCKETS> buckets_ = {};
+  std::atomic<uint64_t> count_ = 0;
+  std::atomic<uint64_t> max_us_ = 0;
+};
+
+// Time spent in each phase of loading a log, in milliseconds
+struct LoadTimings {
+  double queue = 0;       // waiting for a worker thread
+  double read = 0;        // download or read from the file cache
+  double decompress = 0;
+  double parse = 0;
+  double sort = 0;
+  uint64_t finished_ts = 0;  // nanos_since_boot when the log was ready
+};
+
+// Breakdown of one seek, in milliseconds. Log phases are zero when the target segment
+// was already cached, first_frame is zero when no video is published.
+struct SeekTimings {
+  double target_seconds = 0;
+  int segment = -1;
+  double lookup = 0;       // validating the target and interrupting the stream
+  LoadTimings log;
+  double merge = 0;
+  double ready = 0;        // seekTo() until onSeekedTo
+  double first_frame = 0;  // seekTo() until the first frame is sent
+};
+
+struct SeekStats {
+  LatencyHistogram lookup, queue, read, decompress, parse, sort, merge, ready, first_frame;
+  void record(const SeekTimings &t);
+  std::string summary() const;
+};
+
+// Publish timing fidelity per service, indexed by cereal::Event::Which. Lateness is taken after
+// each send against the ideal schedule derived from the log times, the achieved frequency against
+// the nominal rate in services.py, scaled to log time so it is comparable at any playback speed.
+class PublishStats {
+public:
+  struct Row {
+    std::string name;
+    uint64_t count;
+    uint64_t decimated;
+    double nominal_hz, achieved_hz;
+    double p50, p99, max;  // lateness in ms
+  };
+
+  void addService(uint16_t which, const std::string &name, float nominal_hz);
+  inline void record(uint16_t which, double lateness_ms) { services_[which]->lateness.record(lateness_ms); }
+  inline void addPlaybackTime(uint64_t log_ns) { playback_ns_.fetch_add(log_ns, std::memory_order_relaxed); }
+  inline void recordDecimated(uint16_t which) { services_[which]->decimated.fetch_add(1, std::memory_order_relaxed); }
+  inline void recordResync() { resyncs_.fetch_add(1, std::memory_order_relaxed); }
+  inline uint64_t resyncs() const { return resyncs_; }
+  std::vector<Row> snapshot() const;
+  std::string summary() const;
+
+private:
+  struct Service {
+    std::string name;
+    float nominal_hz;
+    LatencyHistogram lateness;
+    std::atomic<uint64_t> decimated = 0;
+  };
+  std::vector<std::unique_ptr<Service>> services_;
+  std::atomic<uint64_t> playback_ns_ = 0;
+  std::atomic<uint64_t> resyncs_ = 0;
+};
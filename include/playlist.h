@@ -0,0 +1,31 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "replay.h"
+
+// Replays a list of routes back-to-back in one process, without the console UI. Once the
+// last segment of the current route is loaded, the next route is listed and its first
+// segments start loading, so it begins publishing as soon as the current one ends.
+class Playlist {
+public:
+  struct Entry {
+    std::string route;  // May carry a segment range, e.g. "<route>/2:5"
+    int start_seconds = 0;
+  };
+
+  Playlist(const ReplayConfig &cfg) : cfg_(cfg) {}
+  // One "<route> [start seconds]" per line, '#' starts a comment. "-" reads stdin.
+  bool load(const std::string &path);
+  // Returns the number of routes that failed to load
+  int exec();
+
+private:
+  ReplayConfig routeConfig(size_t i) const;
+  bool play(size_t i, std::unique_ptr<SegmentManager> preloaded, std::unique_ptr<SegmentManager> &next);
+
+  ReplayConfig cfg_;
+  std::vector<Entry> entries_;
+};
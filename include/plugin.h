@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "msgq/visionipc/visionbuf.h"
+#include "config.h"
+#include "logreader.h"
+
+#define REPLAY_PLUGIN_API_VERSION 1
+
+// Interface of in-process consumers loaded with --plugin. Events and frames are handed
+// over without serialization or copies and are only valid for the duration of the call.
+// onEvent runs on the stream thread in publish order, onFrame on the thread of its camera
+// after the frame was sent over VisionIpc. Run with --max-throughput to drive plugins
+// without pacing, and with --no-msgq to skip the msgq sends.
+class ReplayPlugin {
+public:
+  virtual ~ReplayPlugin() = default;
+  virtual void onEvent(const Event *event) {}
+  virtual void onFrame(CameraType type, const VisionBuf *buf, const Event *encode_idx) {}
+  virtual void onSeek(double seconds) {}
+};
+
+typedef int (*ReplayPluginVersionFn)();
+typedef ReplayPlugin *(*ReplayPluginCreateFn)(const char *args);
+typedef void (*ReplayPluginDestroyFn)(ReplayPlugin *plugin);
+
+// Exports the entry points of a plugin library, PluginClass is constructed from the
+// argument string given after the path: --plugin libfoo.so:args
+#define REPLAY_PLUGIN(PluginClass)                                                                  \
+  extern "C" int replay_plugin_version() { return REPLAY_PLUGIN_API_VERSION; }                      \
+  extern "C" ReplayPlugin *replay_plugin_create(const char *args) { return new PluginClass(args); } \
+  extern "C" void replay_plugin_destroy(ReplayPlugin *plugin) { delete plugin; }
+
+class PluginHost {
+public:
+  ~PluginHost();
+  // Load a plugin from "path[:args]"
+  bool load(const std::string &spec);
+  inline bool empty() const { return plugins_.empty(); }
+  void onEvent(const Event *event);
+  void onFrame(CameraType type, const VisionBuf *buf, const Event *encode_idx);
+  void onSeek(double seconds);
+
+private:
+  struct Plugin {
+    std::string path;
+    void *handle;
+    ReplayPlugin *instance;
+    ReplayPluginDestroyFn destroy;
+  };
+  std::vector<Plugin> plugins_;
+};
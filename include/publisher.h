@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "logreader.h"
+#include "spsc_queue.h"
+
+// Publishes events on a small set of threads, sharded by service so that a slow send only
+// delays the services of its own shard. Every service belongs to exactly one shard, which
+// keeps the per-service order. push() and drain() must be called from one thread only.
+// The grouped services all share one shard, so they are published from a single thread.
+class PublisherPool {
+public:
+  // publish gets the event and the wall time it is due at, 0 if it is not paced
+  using PublishFn = std::function<void(const Event *, uint64_t)>;
+
+  PublisherPool(int num_threads, const std::vector<bool> &services, const std::vector<bool> &grouped, PublishFn publish);
+  ~PublisherPool();
+  void push(const Event *e, uint64_t due_ts);
+  // Wait until every pushed event is published. Events reference segment memory, so the
+  // stream has to drain before it releases the event data.
+  void drain();
+
+private:
+  struct Item {
+    const Event *event = nullptr;
+    uint64_t due_ts = 0;
+  };
+  struct Shard {
+    SPSCQueue<Item> queue{4096};
+    std::atomic<uint64_t> pushed = 0;
+    std::atomic<uint64_t> published = 0;
+    std::atomic<bool> sleeping = false;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::thread thread;
+  };
+  void publishThread(Shard *shard);
+
+  std::vector<std::unique_ptr<Shard>> shards_;
+  std::vector<Shard *> shard_of_;  // by cereal::Event::Which
+  PublishFn publish_;
+  std::atomic<bool> exit_ = false;
+};
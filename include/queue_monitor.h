@@ -0,0 +1,33 @@
+#pragma once
+
+#include <atomic>
+#include <optional>
+#include <string>
+
+#include "msgq/msgq.h"
+
+// Read-only view of the msgq ring buffer of a service, used to keep a publisher
+// from overrunning its slowest reader. Not available with the ZMQ backend.
+class QueueMonitor {
+public:
+  QueueMonitor() = default;
+  ~QueueMonitor();
+  bool open(const std::string &endpoint, size_t size);
+  // Bytes the slowest valid reader is behind the writer, 0 without readers
+  size_t readerLag() const;
+  // Number of valid readers within max_lag bytes of the writer. Readers that exited keep their
+  // slot, they stop counting once the writer moved max_lag past them.
+  int activeReaders(size_t max_lag) const;
+  // Block until every reader is within max_lag bytes. A reader that does not move for
+  // timeout_ms is considered stalled and ignored until it catches up again.
+  void waitForReaders(size_t max_lag, int timeout_ms, const std::atomic<bool> &abort);
+  inline size_t size() const { return q_.size; }
+
+private:
+  // Bytes reader i is behind the writer, nullopt if the slot is not a valid reader
+  std::optional<size_t> lag(uint64_t i) const;
+
+  msgq_queue_t q_ = {};
+  bool opened_ = false;
+  bool stalled_ = false;
+};
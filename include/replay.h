@@ -5,21 +5,34 @@
 #include <memory>
 #include <mutex>
 #include <optional>
+#include <set>
 #include <string>
 #include <vector>
 
 #include "camera.h"
 #include "config.h"
+#include "event_ring.h"
+#include "fanout.h"
+#include "metrics.h"
+#include "plugin.h"
+#include "publisher.h"
+#include "queue_monitor.h"
 #include "seg_mgr.h"
+#include "stream_timer.h"
 #include "timeline.h"
 
+struct service;
+
 class Replay {
 public:
-  Replay(const ReplayConfig &cfg);
+  // preloaded: a route loaded ahead by preloadRoute() with the same config
+  Replay(const ReplayConfig &cfg, std::unique_ptr<SegmentManager> preloaded = nullptr);
   ~Replay();
+  // List the route and start loading the segments at cfg.start_seconds, without publishing
+  static std::unique_ptr<SegmentManager> preloadRoute(const ReplayConfig &cfg);
   bool load();
   RouteLoadError lastRouteError() const { return route().lastError(); }
-  void start(int seconds = 0) { seekTo(min_seconds_ + seconds, false); }
+  void start(int seconds = 0);
   void pause(bool pause);
   void seekToFlag(FindFlag flag);
   void seekTo(double seconds, bool relative);
@@ -36,43 +49,89 @@ public:
   inline double toSeconds(uint64_t mono_time) const { return (mono_time - route_start_ts_) / 1e9; }
   inline double minSeconds() const { return min_seconds_; }
   inline double maxSeconds() const { return max_seconds_; }
-  inline void setSpeed(float speed) { speed_ = speed; }
+  // Takes effect immediately, the stream does not sleep out a deadline set at the old speed
+  inline void setSpeed(float speed) {
+    speed_ = speed;
+    seg_mgr_->setPlaybackSpeed(speed);
+    stream_timer_.wake();
+  }
   inline float getSpeed() const { return speed_; }
   inline const std::string &carFingerprint() const { return car_fingerprint_; }
   inline const std::shared_ptr<std::vector<Timeline::Entry>> getTimeline() const { return timeline_.getEntries(); }
   inline const std::optional<Timeline::Entry> findAlertAtTime(double sec) const { return timeline_.findAlertAtTime(sec); }
   const std::shared_ptr<SegmentManager::EventData> getEventData() const { return seg_mgr_->getEventData(); }
+  // Called on the stream thread for each message, returning true drops it from every output
   void installEventFilter(std::function<bool(const Event *)> filter) { event_filter_ = filter; }
+  SeekTimings lastSeekTimings();
+  inline const SeekStats &seekStats() const { return seek_stats_; }
+  inline const PublishStats &publishStats() const { return publish_stats_; }
+
+  // Lockstep mode (REPLAY_FLAG_LOCKSTEP, API only): the stream only advances when stepped.
+  // Publish the events up to mono_time, or the next n published events, and block until they
+  // are sent.
+  // Returns the number of events published, 0 at the end of the route.
+  size_t stepTo(uint64_t mono_time);
+  size_t stepEvents(size_t n);
 
   // Event callback functions
   std::function<void()> onSegmentsMerged = nullptr;
   std::function<void(double)> onSeeking = nullptr;
   std::function<void(double)> onSeekedTo = nullptr;
   std::function<void(std::shared_ptr<LogReader>)> onQLogLoaded = nullptr;
+  std::function<void()> onRouteEnd = nullptr;  // The stream reached the end and does not loop
 
 private:
   void setupServices(const ReplayConfig& cfg);
-  void setupSegmentManager(const ReplayConfig &cfg);
+  void setupSegmentManager(const ReplayConfig &cfg, std::unique_ptr<SegmentManager> preloaded);
   void startStream(const std::shared_ptr<Segment> segment);
   void streamThread();
   void handleSegmentMerge();
+  void createSockets(const SegmentManager::EventData &event_data);
+  void createSocket(int which);
   void interruptStream(const std::function<bool()>& update_fn);
-  std::vector<Event>::const_iterator publishEvents(std::vector<Event>::const_iterator first,
-                                                   std::vector<Event>::const_iterator last);
-  void publishMessage(const Event *e);
-  void publishFrame(const Event *e);
+  EventIndex::Cursor publishEvents(EventIndex::Cursor it);
+  void dispatchEvent(const Event *e, uint64_t due_ts = 0);
+  void publishEvent(const Event *e, uint64_t due_ts);
+  void publishMessage(const Event *e, uint64_t due_ts);
+  void recordLateness(const Event *e, uint64_t due_ts);
+  void publishFrame(const Event *e, uint64_t due_ts);
   void checkSeekProgress();
+  void finishSeek();
+  size_t step(uint64_t until, size_t n);
+  bool waitForStep(const Event &evt, bool counted);
+  void completeStep(bool at_end);
+  bool reachedRouteEnd() const;
+  QueueMonitor *queueMonitor(int which);
+  bool decimate(const Event &evt, double speed);
 
   std::unique_ptr<SegmentManager> seg_mgr_;
+  bool preloaded_ = false;
+  std::mutex merge_mutex_;
   Timeline timeline_;
 
-  pthread_t stream_thread_id = 0;
   std::thread stream_thread_;
+  StreamTimer stream_timer_;
   std::mutex stream_lock_;
   bool user_paused_ = false;
   std::condition_variable stream_cv_;
   std::atomic<int> current_segment_ = 0;
   std::atomic<double> seeking_to_ = -1.0;
+  std::mutex seek_mutex_;
+  uint64_t seek_start_ts_ = 0;
+  SeekTimings seek_timings_;
+  bool seek_open_ = false;  // seek_timings_ is not recorded yet
+  SeekTimings last_seek_timings_;
+  std::atomic<bool> awaiting_first_frame_ = false;
+  SeekStats seek_stats_;
+  PublishStats publish_stats_;
+
+  std::mutex step_mutex_;
+  std::condition_variable step_cv_;
+  uint64_t step_until_ = 0;
+  size_t step_events_ = 0;
+  size_t step_published_ = 0;
+  bool step_pending_ = false;
+  bool stream_at_end_ = false;
   std::atomic<bool> exit_ = false;
   std::atomic<bool> interrupt_requested_ = false;
   bool events_ready_ = false;
@@ -84,11 +143,27 @@ private:
   double max_seconds_ = 0;
   Context *msg_ctx_ = nullptr;
   std::vector<PubSocket*> sockets_;
+  std::vector<std::string> fanout_prefixes_;
+  std::vector<std::vector<PubSocket *>> fanout_sockets_;  // [prefix][which], created with sockets_
+  std::vector<const service *> service_info_;  // nullptr if the service is not published
+  std::vector<char> socket_failed_;
+  std::set<int> socket_segments_;  // Segments whose services have sockets
+  bool backpressure_ = false;
+  std::vector<std::unique_ptr<QueueMonitor>> queue_monitors_;
+  std::vector<uint64_t> min_publish_interval_;  // log time at 1x between published messages, 0 = no limit
+  std::vector<uint64_t> last_published_mono_;
   std::unique_ptr<CameraServer> camera_server_;
+  std::unique_ptr<PublisherPool> publishers_;
+  std::unique_ptr<EventRingWriter> event_ring_;
+  PluginHost plugins_;
+  std::vector<std::string> plugin_specs_;
+  int video_gap_segment_[MAX_CAMERAS] = {-1, -1, -1};
+  CameraServer::Options camera_options_;
   std::atomic<uint32_t> flags_ = REPLAY_FLAG_NONE;
 
   std::string car_fingerprint_;
   std::atomic<float> speed_ = 1.0;
+  const uint64_t publish_batch_ns_;
   std::function<bool(const Event *)> event_filter_ = nullptr;
 
   std::shared_ptr<SegmentManager::EventData> event_data_ = std::make_shared<SegmentManager::EventData>();
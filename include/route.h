@@ -8,6 +8,7 @@
 #include <thread>
 #include <vector>
 
+#include "executor.h"
 #include "framereader.h"
 #include "logreader.h"
 #include "util.h"
@@ -67,28 +68,35 @@ protected:
   std::string route_string_;
 };
 
+// A segment is Loaded as soon as its log is parsed. Videos are attached
+// independently once their FrameReader is ready, see frameReader().
 class Segment {
 public:
   enum class LoadState {Loading, Loaded, Failed};
 
   Segment(int n, const SegmentFile &files, uint32_t flags, const std::vector<bool> &filters,
-          std::function<void(int, bool)> callback);
+          std::function<void(int, bool)> callback, TaskPriority priority = TaskPriority::Normal,
+          std::shared_ptr<const CompressedLog> cached_log = nullptr);
   ~Segment();
   LoadState getState();
+  size_t memoryUsage();
+  // Shared, so a decoder working ahead keeps the reader alive after the segment is evicted
+  inline std::shared_ptr<FrameReader> frameReader(CameraType cam) const { return frame_ready_[cam] ? frames_[cam] : nullptr; }
 
   const int seg_num = 0;
   std::unique_ptr<LogReader> log;
-  std::unique_ptr<FrameReader> frames[MAX_CAMERAS] = {};
 
 protected:
   void loadFile(int id, const std::string file);
 
-  std::atomic<bool> abort_ = false;
-  std::atomic<int> loading_ = 0;
+  std::shared_ptr<FrameReader> frames_[MAX_CAMERAS] = {};
+  std::atomic<bool> frame_ready_[MAX_CAMERAS] = {};
   std::mutex mutex_;
-  std::vector<std::thread> threads_;
+  TaskGroup tasks_;
   std::function<void(int, bool)> on_load_finished_ = nullptr;
   uint32_t flags;
   std::vector<bool> filters_;
+  std::shared_ptr<const CompressedLog> cached_log_;
+  const double created_ts_;
   LoadState load_state_  = LoadState::Loading;
 };
@@ -1,12 +1,16 @@
 #pragma once
 
+#include <atomic>
 #include <condition_variable>
+#include <list>
 #include <map>
 #include <mutex>
 #include <set>
+#include <utility>
 #include <vector>
 
 #include "config.h"
+#include "event_index.h"
 #include "route.h"
 
 using SegmentMap = std::map<int, std::shared_ptr<Segment>>;
@@ -14,8 +18,10 @@ using SegmentMap = std::map<int, std::shared_ptr<Segment>>;
 class SegmentManager {
 public:
   struct EventData {
-    std::vector<Event> events;  //  Events extracted from the segments
+    EventIndex events;          // Events of the segments, one sorted chunk per segment
     SegmentMap segments;        // Associated segments that contributed to these events
+    double merge_ms = 0;        // Time spent building this event data
+    uint64_t merged_ts = 0;     // nanos_since_boot when it was published
     bool isSegmentLoaded(int n) const { return segments.find(n) != segments.end(); }
   };
 
@@ -24,19 +30,34 @@ public:
 
   bool load();
   void setCurrentSegment(int seg_num);
+  void setPlaybackSpeed(float speed);
   void setSegmentCacheLimit(int n) { segment_cache_limit_ = std::max(MIN_SEGMENTS_CACHE, n); }
-  void setCallback(const std::function<void()> &callback) { onSegmentMergedCallback_ = callback; }
+  void setCacheMemoryLimit(size_t bytes, size_t reserve = 0) { cache_memory_ = bytes; mem_reserve_ = reserve; }
+  size_t memoryUsage() const { return memory_usage_; }
+  size_t warmMemoryUsage();
+  void setCallback(const std::function<void()> &callback) {
+    std::lock_guard lock(mutex_);  // May be handed over while a preloaded route is loading
+    onSegmentMergedCallback_ = callback;
+  }
   void setFilters(const std::vector<bool> &filters) { filters_ = filters; }
   const std::shared_ptr<EventData> getEventData() const { return std::atomic_load(&event_data_); }
   bool hasSegment(int n) const { return segments_.find(n) != segments_.end(); }
 
   Route route_;
   int segment_cache_limit_ = MIN_SEGMENTS_CACHE;
+  std::atomic<size_t> cache_memory_ = 0;
+  std::atomic<size_t> mem_reserve_ = 0;
 
 private:
   void manageSegmentCache();
+  float aheadRatio() const;
+  std::pair<SegmentMap::iterator, SegmentMap::iterator> cacheWindow(SegmentMap::iterator cur, float ahead_ratio);
+  std::pair<SegmentMap::iterator, SegmentMap::iterator> memoryWindow(SegmentMap::iterator cur, float ahead_ratio);
   void loadSegmentsInRange(SegmentMap::iterator begin, SegmentMap::iterator cur, SegmentMap::iterator end);
   bool mergeSegments(const SegmentMap::iterator &begin, const SegmentMap::iterator &end);
+  void evictSegment(std::shared_ptr<Segment> &segment);
+  std::shared_ptr<const CompressedLog> warmLog(int seg_num);
+  void addWarmLog(int seg_num, std::shared_ptr<const CompressedLog> log);
 
   std::vector<bool> filters_;
   uint32_t flags_;
@@ -45,6 +66,8 @@ private:
   std::condition_variable cv_;
   std::thread thread_;
   int cur_seg_num_ = -1;
+  float playback_speed_ = 1.0f;
+  float seek_bias_ = 0.0f;  // -1 after repeated backward seeks, 1 after repeated forward seeks
   bool needs_update_ = false;
   bool exit_ = false;
 
@@ -52,4 +75,13 @@ private:
   std::shared_ptr<EventData> event_data_;
   std::function<void()> onSegmentMergedCallback_ = nullptr;
   std::set<int> merged_segments_;
+  std::atomic<size_t> memory_usage_ = 0;
+
+  // Warm tier: compressed logs of segments that left the window, least recently used first
+  const size_t warm_cache_memory_;
+  std::mutex warm_mutex_;
+  std::list<std::pair<int, std::shared_ptr<const CompressedLog>>> warm_logs_;
+  size_t warm_usage_ = 0;
+  std::atomic<size_t> warm_pending_memory_ = 0;  // Evicted segments queued for compression
+  TaskGroup warm_tasks_;
 };
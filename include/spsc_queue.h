@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Bounded lock-free queue for exactly one producer and one consumer thread. Each side
+// caches the other side's index, so the shared atomics are only read when the cached
+// value says the queue is full or empty.
+template <typename T>
+class SPSCQueue {
+public:
+  explicit SPSCQueue(size_t capacity) : buffer_(roundUp(capacity)), mask_(buffer_.size() - 1) {}
+
+  bool push(const T &value) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_cache_ == buffer_.size()) {
+      head_cache_ = head_.load(std::memory_order_acquire);
+      if (tail - head_cache_ == buffer_.size()) return false;
+    }
+    buffer_[tail & mask_] = value;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool pop(T &value) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_cache_) {
+      tail_cache_ = tail_.load(std::memory_order_acquire);
+      if (head == tail_cache_) return false;
+    }
+    value = buffer_[head & mask_];
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool empty() const { return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire); }
+
+private:
+  static size_t roundUp(size_t n) {
+    size_t size = 2;
+    while (size < n) size <<= 1;
+    return size;
+  }
+
+  std::vector<T> buffer_;
+  const size_t mask_;
+  alignas(64) std::atomic<size_t> head_ = 0;  // consumer
+  size_t tail_cache_ = 0;
+  alignas(64) std::atomic<size_t> tail_ = 0;  // producer
+  size_t head_cache_ = 0;
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+// Interruptible sleep of the stream thread. On Linux this is an epoll loop over a timerfd
+// armed with absolute CLOCK_MONOTONIC deadlines and an eventfd that other threads write to
+// wake it, so no signals are involved. Other platforms, or Linux when the descriptors can
+// not be created, fall back to a condition variable.
+class StreamTimer {
+public:
+  StreamTimer();
+  ~StreamTimer();
+  // Sleep until the deadline (nanos_monotonic). Returns false if woken up before it.
+  bool sleepUntil(uint64_t deadline_ns);
+  void wake();
+
+private:
+  bool waitUntil(uint64_t deadline_ns);
+  void notify();
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool woken_ = false;
+#ifndef __APPLE__
+  int epoll_fd_ = -1;
+  int timer_fd_ = -1;
+  int event_fd_ = -1;
+#endif
+};
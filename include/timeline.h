@@ -1,10 +1,11 @@
 #pragma once
 
 #include <atomic>
+#include <map>
 #include <optional>
-#include <thread>
 #include <vector>
 
+#include "executor.h"
 #include "route.h"
 
 enum class TimelineType { None, Engaged, AlertInfo, AlertWarning, AlertCritical, UserBookmark };
@@ -30,13 +31,18 @@ public:
   const std::shared_ptr<std::vector<Entry>> getEntries() const { return std::atomic_load(&timeline_entries_); }
 
 private:
-  void buildTimeline(const Route &route, uint64_t route_start_ts, bool local_cache,
-                     std::function<void(std::shared_ptr<LogReader>)> callback);
+  void buildTimeline(std::map<int, SegmentFile>::const_iterator it);
   void updateEngagementStatus(const cereal::SelfdriveState::Reader &cs, std::optional<size_t> &idx, double seconds);
   void updateAlertStatus(const cereal::SelfdriveState::Reader &cs, std::optional<size_t> &idx, double seconds);
 
-  std::thread thread_;
-  std::atomic<bool> should_exit_ = false;
+  // Segments are processed one low priority task at a time, so the timeline never
+  // holds a worker while segments for playback are waiting to load.
+  TaskGroup tasks_;
+  std::map<int, SegmentFile> segments_;
+  uint64_t route_start_ts_ = 0;
+  bool local_cache_ = false;
+  std::function<void(std::shared_ptr<LogReader>)> callback_;
+  std::optional<size_t> current_engaged_idx_, current_alert_idx_;
 
   // Temporarily holds entries before they are sorted and finalized
   std::vector<Entry> staging_entries_;
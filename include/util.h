@@ -31,18 +31,20 @@ public:
   ~MonotonicBuffer();
   void *allocate(size_t bytes, size_t alignment = 16ul);
   void deallocate(void *p) {}
+  inline size_t allocatedSize() const { return allocated_size; }
 
 private:
   void *current_buf = nullptr;
   size_t next_buffer_size = 0;
   size_t available = 0;
+  size_t allocated_size = 0;
   std::deque<void *> buffers;
   static constexpr float growth_factor = 1.5;
 };
 
 std::string sha256(const std::string &str);
-void precise_nano_sleep(int64_t nanoseconds, std::atomic<bool> &interrupt_requested);
 std::string formattedDataSize(size_t size);
+size_t memAvailable();
 std::string extractFileName(const std::string& file);
 std::vector<std::string> split(std::string_view source, char delimiter);
 
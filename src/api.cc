@@ -121,7 +121,7 @@ std::string create_token(bool use_jwt, const json &payloads, int expiry) {
   }
 }
 
-std::string httpGet(const std::string &url, long *response_code) {
+std::string httpGet(const std::string &url, long *response_code, long timeout_ms) {
   CURL *curl = curl_easy_init();
   assert(curl);
 
@@ -140,6 +140,10 @@ std::string httpGet(const std::string &url, long *response_code) {
   curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeCallback);
   curl_easy_setopt(curl, CURLOPT_WRITEDATA, &readBuffer);
   curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+  if (timeout_ms > 0) {
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, timeout_ms);
+  }
 
   // Handle headers
   struct curl_slist *headers = nullptr;
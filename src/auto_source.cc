@@ -0,0 +1,220 @@
+#include "auto_source.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <regex>
+#include <thread>
+#include <vector>
+
+#include "api.h"
+#include "hardware.h"
+#include "http.h"
+#include "util.h"
+
+namespace {
+
+using LogFiles = std::map<int, std::string>;
+using SourceFn = std::function<LogFiles(const RouteIdentifier &, std::atomic<bool> *)>;
+
+// In order of preference: full logs first, fallback to qlogs
+const std::vector<std::string> LOG_FILE_NAMES = {"rlog.zst", "rlog.bz2", "qlog.zst", "qlog.bz2"};
+const int PROBE_BATCH_SEGMENTS = 10;
+const long API_TIMEOUT_MS = 5000;
+// Sources still probing after this are not waited for
+const int RESOLVE_TIMEOUT_MS = 10000;
+
+struct AutoSource {
+  const char *name;
+  SourceFn resolve;
+};
+
+// Probe the log files of each segment with concurrent HEAD requests. An open-ended range
+// is probed in batches until the first missing segment, a closed range is probed entirely.
+LogFiles probeRemoteSource(const RouteIdentifier &route, const std::function<std::string(int)> &segment_url,
+                           std::atomic<bool> *abort) {
+  LogFiles files;
+  const bool open_end = route.end_segment < 0;
+  for (int begin = route.begin_segment; !*abort; begin += PROBE_BATCH_SEGMENTS) {
+    int end = begin + PROBE_BATCH_SEGMENTS;
+    if (!open_end) end = std::min(end, route.end_segment + 1);
+    if (begin >= end) break;
+
+    std::vector<std::string> urls;
+    for (int seg = begin; seg < end; ++seg) {
+      for (const auto &name : LOG_FILE_NAMES) {
+        urls.push_back(segment_url(seg) + name);
+      }
+    }
+
+    auto exists = remoteFilesExist(urls, abort);
+    for (int seg = begin; seg < end; ++seg) {
+      size_t first = (seg - begin) * LOG_FILE_NAMES.size();
+      auto it = std::find(exists.begin() + first, exists.begin() + first + LOG_FILE_NAMES.size(), true);
+      if (it == exists.begin() + first + LOG_FILE_NAMES.size()) {
+        if (open_end) return files;
+        continue;
+      }
+      files[seg] = urls[it - exists.begin()];
+    }
+  }
+  return files;
+}
+
+SourceFn remoteSource(const std::string &base_url) {
+  return [base_url](const RouteIdentifier &route, std::atomic<bool> *abort) -> LogFiles {
+    if (route.dongle_id.empty()) return {};
+
+    std::string route_url = base_url + route.dongle_id + "/" + route.timestamp + "/";
+    return probeRemoteSource(route, [&](int seg) { return route_url + std::to_string(seg) + "/"; }, abort);
+  };
+}
+
+LogFiles commaApiSource(const RouteIdentifier &route, std::atomic<bool> *abort) {
+  if (route.dongle_id.empty()) return {};
+
+  long response_code = 0;
+  std::string result = CommaApi2::httpGet(CommaApi2::BASE_URL + "/v1/route/" + route.str + "/files", &response_code,
+                                          API_TIMEOUT_MS);
+  if (response_code != 200 || *abort) return {};
+
+  const static std::regex rx(R"(\/(\d+)\/)");
+  LogFiles files;
+  try {
+    auto data = json::parse(result);
+    for (const char *key : {"logs", "qlogs"}) {
+      if (!data.contains(key) || !data[key].is_array()) continue;
+
+      for (const std::string &url : data[key]) {
+        std::smatch match;
+        if (std::regex_search(url, match, rx)) {
+          files.emplace(std::stoi(match[1]), url);  // keeps rlog if already present
+        }
+      }
+    }
+  } catch (const json::exception &e) {
+    rWarning("JSON error: %s", e.what());
+  }
+
+  files.erase(files.begin(), files.lower_bound(route.begin_segment));
+  if (route.end_segment >= 0) {
+    files.erase(files.upper_bound(route.end_segment), files.end());
+  }
+  return files;
+}
+
+LogFiles localSource(const std::vector<std::string> &dirs, const RouteIdentifier &route) {
+  const std::string pattern = route.timestamp + "--";
+  LogFiles files;
+  for (const auto &dir : dirs) {
+    std::error_code ec;
+    if (dir.empty() || !std::filesystem::is_directory(dir, ec)) continue;
+
+    for (const auto &entry : std::filesystem::directory_iterator(dir, ec)) {
+      std::string segment = entry.path().filename().string();
+      if (!entry.is_directory() || segment.find(pattern) != 0) continue;
+
+      int seg_num = std::atoi(segment.substr(pattern.size()).c_str());
+      if (seg_num < route.begin_segment || (route.end_segment >= 0 && seg_num > route.end_segment)) continue;
+
+      for (const auto &name : LOG_FILE_NAMES) {
+        auto file = entry.path() / name;
+        if (std::filesystem::exists(file, ec)) {
+          files.emplace(seg_num, file.string());  // The first directory has precedence
+          break;
+        }
+      }
+    }
+  }
+  return files;
+}
+
+bool isFullLog(const std::string &file) {
+  return file.find("rlog") != std::string::npos;
+}
+
+// For each segment, take the full log over a qlog and then the earlier source
+LogFiles mergeSources(const std::vector<LogFiles> &results) {
+  LogFiles merged;
+  for (const auto &files : results) {
+    for (const auto &[seg, file] : files) {
+      auto [it, inserted] = merged.emplace(seg, file);
+      if (!inserted && !isFullLog(it->second) && isFullLog(file)) it->second = file;
+    }
+  }
+  return merged;
+}
+
+// Every segment of a closed range is present. An open-ended range is never known complete.
+bool isComplete(const LogFiles &files, const RouteIdentifier &route) {
+  if (route.end_segment < 0 || files.empty()) return false;
+  return files.begin()->first == route.begin_segment && files.rbegin()->first == route.end_segment &&
+         files.size() == (size_t)(route.end_segment - route.begin_segment + 1);
+}
+
+}  // namespace
+
+std::map<int, std::string> resolveAutoSource(const RouteIdentifier &route, const std::string &data_dir) {
+  const std::string data_endpoint = util::getenv("DATA_ENDPOINT", "http://data-raw.comma.internal/");
+  const std::vector<std::string> local_dirs = {data_dir, Path::log_root()};
+  const std::vector<AutoSource> sources = {
+      {"local", [=](const RouteIdentifier &r, std::atomic<bool> *) { return localSource(local_dirs, r); }},
+      {"internal", remoteSource(data_endpoint.back() == '/' ? data_endpoint : data_endpoint + "/")},
+      {"openpilotci", remoteSource("https://commadataci.blob.core.windows.net/openpilotci/")},
+      {"comma_api", commaApiSource},
+      {"car_segments", remoteSource("https://huggingface.co/datasets/commaai/commaCarSegments/resolve/main/segments/")},
+      {"testing_closet", remoteSource("http://testing.comma.life/")},
+  };
+
+  // Shared with the probing threads, which are detached so that a slow source never delays
+  // the startup once the others have answered. A closed range is done when every segment is
+  // found, an open-ended one when the first source found logs.
+  struct State {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::atomic<bool> abort = false;
+    size_t pending = 0;
+    std::vector<LogFiles> results;
+    bool complete = false;
+  };
+  auto state = std::make_shared<State>();
+  state->pending = sources.size();
+  state->results.resize(sources.size());
+
+  for (size_t i = 0; i < sources.size(); ++i) {
+    std::thread([state, source = sources[i], route, i]() {
+      LogFiles files = source.resolve(route, &state->abort);
+      {
+        std::lock_guard lock(state->mutex);
+        if (!files.empty()) rInfo("auto source: %s has %zu segments", source.name, files.size());
+        state->results[i] = std::move(files);
+        LogFiles merged = mergeSources(state->results);
+        state->complete = route.end_segment >= 0 ? isComplete(merged, route) : !merged.empty();
+        if (state->complete) state->abort = true;
+        --state->pending;
+      }
+      state->cv.notify_one();
+    }).detach();
+  }
+
+  std::unique_lock lock(state->mutex);
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(RESOLVE_TIMEOUT_MS);
+  if (!state->cv.wait_until(lock, deadline, [&]() { return state->complete || state->pending == 0; })) {
+    rWarning("auto source: %zu sources did not answer in time", state->pending);
+  }
+  state->abort = true;
+
+  LogFiles files = mergeSources(state->results);
+  if (files.empty()) {
+    rWarning("auto source: no source found for %s", route.str.c_str());
+  } else if (route.end_segment >= 0 && !state->complete) {
+    rWarning("auto source: found %zu of %d segments", files.size(), route.end_segment - route.begin_segment + 1);
+  } else {
+    rInfo("auto source: found %zu segments", files.size());
+  }
+  return files;
+}
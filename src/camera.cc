@@ -1,14 +1,22 @@
 #include "camera.h"
 
 #include <cassert>
+#include <cstring>
 #include <algorithm>
 
 #include <capnp/dynamic.h>
 
+#include "common/timing.h"
+#include "fanout.h"
 #include "linux/include/msm_media_info.h"
+#include "msgq/ipc.h"
 #include "util.h"
 
-const int BUFFER_COUNT = 40;
+const int BUFFER_COUNT = 40;  // Per stream, the decode-ahead ring takes at most half of them
+// A VisionIpc message is under 64 bytes, a reader this far behind missed seconds of frames
+const size_t MAX_SUBSCRIBER_LAG = 4096;
+const int MIN_DECODE_SAMPLES = 10;
+const double PROBE_INTERVAL_MS = 10000;  // How long to stay on key frames before trying full frame rate
 
 std::tuple<size_t, size_t, size_t> get_nv12_info(int width, int height) {
   int nv12_width = VENUS_Y_STRIDE(COLOR_FMT_NV12, width);
@@ -19,9 +27,12 @@ std::tuple<size_t, size_t, size_t> get_nv12_info(int width, int height) {
   return {nv12_width, nv12_height, nv12_buffer_size};
 }
 
-CameraServer::CameraServer(std::pair<int, int> camera_size[MAX_CAMERAS]) {
+CameraServer::CameraServer(std::pair<int, int> camera_size[MAX_CAMERAS], const Options &options) : options_(options) {
+  const int decode_ahead = std::clamp(options_.decode_ahead, 1, BUFFER_COUNT / 2);
   for (int i = 0; i < MAX_CAMERAS; ++i) {
     std::tie(cameras_[i].width, cameras_[i].height) = camera_size[i];
+    cameras_[i].ring.resize(decode_ahead);
+    cameras_[i].queue = std::make_unique<MPMCQueue<FrameRequest>>(std::max(1, options_.queue_size));
   }
   startVipcServer();
 }
@@ -33,86 +44,296 @@ CameraServer::~CameraServer() {
         std::unique_lock<std::mutex> lk(cam.mutex);
         cam.terminate = true;
         cam.cv_ready.notify_one();
+        cam.cv_decode.notify_one();
+        cam.cv_decoded.notify_all();
       }
      cam.thread.join();
+     cam.decode_thread.join();
     }
+    resetDecodeAhead(cam);
+    if (cam.dropped > 0) {
+      rInfo("camera[%d] dropped %lu of %lu frames", cam.type, cam.dropped.load(), cam.pushed.load());
+    }
+    if (cam.degraded > 0) {
+      rInfo("camera[%d] skipped %lu of %lu frames decoding only key frames", cam.type, cam.degraded.load(), cam.pushed.load());
+    }
+    if (cam.skipped > 0) {
+      rInfo("camera[%d] skipped decoding %lu frames without subscribers", cam.type, cam.skipped.load());
+    }
+    cam.monitors.clear();
   }
+  fanout_servers_.clear();
   vipc_server_.reset(nullptr);
 }
 
 void CameraServer::startVipcServer() {
+  for (auto &cam : cameras_) {
+    resetDecodeAhead(cam);  // The ring holds buffers of the previous server
+    if (cam.width > 0 && cam.height > 0) {
+      rInfo("camera[%d] frame size %dx%d", cam.type, cam.width, cam.height);
+    }
+  }
+
+  // A resolution change restarts every server with buffers of the new size
+  fanout_servers_.clear();
   vipc_server_.reset(new VisionIpcServer("camerad"));
+  createBuffers(vipc_server_.get());
+  vipc_server_->start_listener();
+  // Fan-out namespaces link their "camerad" to these servers, see FanoutPrefix
+  for (const auto &prefix : options_.fanout_prefixes) {
+    auto &server = fanout_servers_.emplace_back(new VisionIpcServer(fanoutVipcName(prefix)));
+    createBuffers(server.get());
+    server->start_listener();
+  }
+
   for (auto &cam : cameras_) {
-    cam.cached_buf.clear();
+    if (cam.width > 0 && cam.height > 0) openMonitors(cam);
+    if (cam.width > 0 && cam.height > 0 && !cam.thread.joinable()) {
+      cam.thread = std::thread(&CameraServer::cameraThread, this, std::ref(cam));
+      cam.decode_thread = std::thread(&CameraServer::decodeThread, this, std::ref(cam));
+    }
+  }
+}
 
+void CameraServer::createBuffers(VisionIpcServer *server) {
+  for (auto &cam : cameras_) {
     if (cam.width > 0 && cam.height > 0) {
-      rInfo("camera[%d] frame size %dx%d", cam.type, cam.width, cam.height);
       auto [nv12_width, nv12_height, nv12_buffer_size] = get_nv12_info(cam.width, cam.height);
-      vipc_server_->create_buffers_with_sizes(cam.stream_type, BUFFER_COUNT, cam.width, cam.height,
-                                              nv12_buffer_size, nv12_width, nv12_width * nv12_height);
-      if (!cam.thread.joinable()) {
-        cam.thread = std::thread(&CameraServer::cameraThread, this, std::ref(cam));
+      server->create_buffers_with_sizes(cam.stream_type, BUFFER_COUNT, cam.width, cam.height,
+                                        nv12_buffer_size, nv12_width, nv12_width * nv12_height);
+    }
+  }
+}
+
+void CameraServer::openMonitors(Camera &cam) {
+  std::vector<std::unique_ptr<QueueMonitor>> monitors;
+  if (!messaging_use_zmq()) {
+    std::vector<std::string> servers = {"camerad"};
+    for (const auto &prefix : options_.fanout_prefixes) servers.push_back(fanoutVipcName(prefix));
+    for (const auto &server : servers) {
+      // Same as get_endpoint_name() in VisionIpc
+      const std::string endpoint = "visionipc_" + server + "_" + std::to_string(cam.stream_type);
+      auto monitor = std::make_unique<QueueMonitor>();
+      if (!monitor->open(endpoint, DEFAULT_SEGMENT_SIZE)) {
+        rWarning("camera[%d] failed to monitor %s, decoding every frame", cam.type, endpoint.c_str());
+        monitors.clear();
+        break;
       }
+      monitors.push_back(std::move(monitor));
     }
   }
-  vipc_server_->start_listener();
+
+  std::unique_lock lk(cam.mutex);
+  cam.monitors = std::move(monitors);
+}
+
+// Switch to decoding only key frames while a frame takes longer to decode than the time between
+// frames at the playback speed, and back once it fits again. Frames of the logged streams all
+// reference the previous one, so key frames are the only ones that can be decoded on their own.
+void CameraServer::updateDecodeMode(Camera &cam, uint64_t mono_time) {
+  const uint64_t interval = mono_time - cam.last_frame_time;
+  cam.last_frame_time = mono_time;
+  if (interval == 0 || interval > 1e9) return;  // Seek or gap between segments
+
+  const double interval_ms = interval / 1e6;
+  cam.frame_interval_ms = cam.frame_interval_ms > 0 ? cam.frame_interval_ms * 0.9 + interval_ms * 0.1 : interval_ms;
+  const double budget_ms = cam.frame_interval_ms / std::max(options_.speed->load(), 0.1f);
+
+  std::unique_lock lk(cam.mutex);
+  if (!cam.keyframes_only) {
+    if (cam.decode_samples < MIN_DECODE_SAMPLES) return;
+
+    if (cam.decode_ms > budget_ms * 0.9) {
+      if (!cam.probing) {
+        rWarning("camera[%d] decoding takes %.1fms per frame, %.1fms at %.1fx. decoding only key frames",
+                 cam.type, cam.decode_ms, budget_ms, options_.speed->load());
+      }
+      cam.keyframes_only = true;
+      cam.degraded_at = millis_since_boot();
+      cam.cv_decode.notify_one();
+    } else if (cam.probing) {
+      rInfo("camera[%d] decoding every frame again", cam.type);
+    }
+    cam.probing = false;
+  } else {
+    // decode_ms is the last cost at full frame rate, retry it when the speed drops or periodically
+    const bool fits = cam.decode_ms < budget_ms * 0.6;
+    if (fits || millis_since_boot() - cam.degraded_at > PROBE_INTERVAL_MS) {
+      if (fits) rInfo("camera[%d] decoding every frame again", cam.type);
+      cam.keyframes_only = false;
+      cam.probing = !fits;
+      cam.decode_samples = 0;
+    }
+  }
+}
+
+// Frames are decoded only while a VisionIpc client reads the stream in some prefix, or a
+// plugin takes them through the frame callback
+bool CameraServer::hasSubscribers(Camera &cam) {
+  if (frame_callback_ || cam.monitors.empty()) return true;
+
+  const bool subscribed = std::any_of(cam.monitors.begin(), cam.monitors.end(), [](auto &monitor) {
+    return monitor->activeReaders(MAX_SUBSCRIBER_LAG) > 0;
+  });
+  if (subscribed != cam.subscribed) {
+    rInfo("camera[%d] %s", cam.type, subscribed ? "client subscribed, decoding resumed" : "no subscribers, decoding paused");
+    cam.subscribed = subscribed;
+  }
+  return subscribed;
+}
+
+void CameraServer::sendFanout(Camera &cam, const VisionBuf *yuv, VisionIpcBufExtra *extra) {
+  for (auto &server : fanout_servers_) {
+    VisionBuf *buf = server->get_buffer(cam.stream_type);
+    memcpy(buf->addr, yuv->addr, std::min(buf->len, yuv->len));
+    buf->set_frame_id(extra->frame_id);
+    server->send(buf, extra);
+  }
 }
 
 void CameraServer::cameraThread(Camera &cam) {
+  // on_sent of a frame that was not sent, called once the next frame is
+  std::function<void()> pending_on_sent;
   while (true) {
-    std::pair<FrameReader*, const Event*> work;
+    FrameRequest request;
     {
       std::unique_lock<std::mutex> lk(cam.mutex);
-      cam.cv_ready.wait(lk, [&] { return cam.pending || cam.terminate; });
       if (cam.terminate) break;
-      work = {cam.fr, cam.event};
+      if (!cam.queue->pop(request)) {
+        // pushFrame() notifies under the mutex, so a push after the pop above is not missed
+        cam.sleeping = true;
+        cam.cv_ready.wait(lk, [&] { return cam.terminate || !cam.queue->empty(); });
+        cam.sleeping = false;
+        continue;
+      }
     }
 
-    auto [fr, event] = work;
+    auto &[fr, event, on_sent] = request;
+    if (on_sent) pending_on_sent = std::move(on_sent);
     capnp::FlatArrayMessageReader reader(event->data);
     auto evt = reader.getRoot<cereal::Event>();
     auto eidx = capnp::AnyStruct::Reader(evt).getPointerSection()[0].getAs<cereal::EncodeIndex>();
 
     int segment_id = eidx.getSegmentId();
     uint32_t frame_id = eidx.getFrameId();
-    if (auto yuv = getFrame(cam, fr, segment_id, frame_id)) {
+    if (options_.speed) updateDecodeMode(cam, event->mono_time);
+
+    if (!hasSubscribers(cam)) {
+      // Idle the decode thread. On resume the decoder restarts at the key frame of the GOP.
+      std::unique_lock lk(cam.mutex);
+      cam.request_fr = nullptr;
+      ++cam.skipped;
+    } else if (cam.keyframes_only && segment_id < fr->getFrameCount() && !fr->isKeyFrame(segment_id)) {
+      ++cam.degraded;
+    } else if (auto yuv = getFrame(cam, fr, segment_id, frame_id)) {
       VisionIpcBufExtra extra = {
           .frame_id = frame_id,
           .timestamp_sof = eidx.getTimestampSof(),
           .timestamp_eof = eidx.getTimestampEof(),
       };
       vipc_server_->send(yuv, &extra);
+      sendFanout(cam, yuv, &extra);
+      if (frame_callback_) frame_callback_(cam.type, yuv, event);
+      if (pending_on_sent) {
+        pending_on_sent();
+        pending_on_sent = nullptr;
+      }
     } else {
       rError("camera[%d] failed to get frame: %lu", cam.type, segment_id);
     }
 
-    // Prefetch the next frame
-    getFrame(cam, fr, segment_id + 1, frame_id + 1);
-
+    request = {};  // Release the reader before reporting the frame done
     {
       std::unique_lock<std::mutex> lk(cam.mutex);
-      cam.pending = false;
+      ++cam.done;
     }
-    cam.cv_sent.notify_one();
+    cam.cv_sent.notify_all();
   }
 }
 
-VisionBuf *CameraServer::getFrame(Camera &cam, FrameReader *fr, int32_t segment_id, uint32_t frame_id) {
-  // Check if the frame is cached
-  auto buf_it = std::find_if(cam.cached_buf.begin(), cam.cached_buf.end(),
-                             [frame_id](VisionBuf *buf) { return buf->get_frame_id() == frame_id; });
-  if (buf_it != cam.cached_buf.end()) return *buf_it;
+// Request a frame and wait for the decode thread. Sequential frames are usually decoded already.
+VisionBuf *CameraServer::getFrame(Camera &cam, const std::shared_ptr<FrameReader> &fr, int idx, uint32_t frame_id) {
+  if (idx < 0 || idx >= fr->getFrameCount()) return nullptr;
+
+  std::unique_lock lk(cam.mutex);
+  if (cam.request_fr != fr) releaseStaleFrames(cam, fr);
+  cam.request_fr = fr;
+  cam.request_idx = idx;
+  cam.request_frame_id = frame_id;
+  cam.cv_decode.notify_one();
+
+  const auto &slot = cam.ring[frame_id % cam.ring.size()];
+  cam.cv_decoded.wait(lk, [&]() { return cam.terminate || (slot.fr == fr && slot.frame_id == frame_id); });
+  return cam.terminate ? nullptr : slot.buf;
+}
+
+void CameraServer::decodeThread(Camera &cam) {
+  std::unique_lock lk(cam.mutex);
+  while (true) {
+    // The first frame from the requested one on that is not in the ring yet
+    std::shared_ptr<FrameReader> fr;
+    int idx = 0;
+    uint32_t frame_id = 0;
+    cam.cv_decode.wait(lk, [&]() {
+      if (cam.terminate) return true;
+      if (!cam.request_fr) return false;
+
+      const int ahead = std::min<int>(cam.ring.size(), cam.request_fr->getFrameCount() - cam.request_idx);
+      for (int i = 0; i < ahead; ++i) {
+        const uint32_t id = cam.request_frame_id + i;
+        if (cam.keyframes_only && !cam.request_fr->isKeyFrame(cam.request_idx + i)) continue;
+
+        const auto &slot = cam.ring[id % cam.ring.size()];
+        if (slot.fr != cam.request_fr || slot.frame_id != id) {
+          fr = cam.request_fr;
+          idx = cam.request_idx + i;
+          frame_id = id;
+          return true;
+        }
+      }
+      return false;
+    });
+    if (cam.terminate) break;
+
+    cam.decoding = true;
+    VisionBuf *buf = vipc_server_->get_buffer(cam.stream_type);
+    lk.unlock();
+    const bool sequential = idx == fr->prev_idx + 1;
+    const double start_ms = millis_since_boot();
+    if (fr->get(idx, buf)) {
+      buf->set_frame_id(frame_id);
+    } else {
+      buf = nullptr;
+    }
+    const double decode_ms = millis_since_boot() - start_ms;
+    lk.lock();
+    if (sequential && buf) {
+      cam.decode_ms = cam.decode_samples++ > 0 ? cam.decode_ms * 0.9 + decode_ms * 0.1 : decode_ms;
+    }
+    cam.decoding = false;
+    // The slot held a frame before the request, which was sent already
+    cam.ring[frame_id % cam.ring.size()] = {fr, frame_id, buf};
+    cam.cv_decoded.notify_all();
+  }
+}
 
-  VisionBuf *yuv_buf = vipc_server_->get_buffer(cam.stream_type);
-  if (fr->get(segment_id, yuv_buf)) {
-    yuv_buf->set_frame_id(frame_id);
-    cam.cached_buf.insert(yuv_buf);
-    return yuv_buf;
+// Called with cam.mutex held. Frames decoded ahead by another reader keep its segment alive
+// after the cache evicted it, they are never requested once the stream moved on.
+void CameraServer::releaseStaleFrames(Camera &cam, const std::shared_ptr<FrameReader> &fr) {
+  for (auto &slot : cam.ring) {
+    if (slot.fr && slot.fr != fr) slot = {};
   }
-  return nullptr;
 }
 
-void CameraServer::pushFrame(CameraType type, FrameReader *fr, const Event *event) {
+void CameraServer::resetDecodeAhead(Camera &cam) {
+  std::unique_lock lk(cam.mutex);
+  cam.request_fr = nullptr;
+  cam.cv_decoded.wait(lk, [&]() { return !cam.decoding; });
+  cam.ring.assign(cam.ring.size(), {});
+}
+
+void CameraServer::pushFrame(CameraType type, std::shared_ptr<FrameReader> fr, const Event *event,
+                             std::function<void()> on_sent) {
   auto &cam = cameras_[type];
   // Handle resolution change: drain and restart
   if (cam.width != fr->width || cam.height != fr->height) {
@@ -122,19 +343,59 @@ void CameraServer::pushFrame(CameraType type, FrameReader *fr, const Event *even
     startVipcServer();
   }
 
+  FrameRequest request = {fr, event, std::move(on_sent)};
+  FrameRequest oldest;
+  // A dropped frame hands its on_sent on to this one
+  auto drop = [&]() {
+    if (oldest.on_sent && !request.on_sent) request.on_sent = std::move(oldest.on_sent);
+    oldest = {};
+    dropFrame(cam);
+  };
+  if (options_.policy == FrameQueuePolicy::Latest) {
+    while (cam.queue->pop(oldest)) drop();
+  }
+  while (true) {
+    // Read before pushing: a frame taken from the full queue is counted done after this
+    const uint64_t done = cam.done;
+    if (cam.queue->push(request)) break;
+
+    if (options_.policy != FrameQueuePolicy::Block) {
+      if (cam.queue->pop(oldest)) drop();
+    } else {
+      std::unique_lock<std::mutex> lk(cam.mutex);
+      cam.cv_sent.wait(lk, [&] { return cam.done != done; });
+    }
+  }
+  ++cam.pushed;
+
+  std::unique_lock<std::mutex> lk(cam.mutex);
+  if (cam.sleeping) cam.cv_ready.notify_one();  // Wake up consumer
+}
+
+void CameraServer::dropFrame(Camera &cam) {
   {
     std::unique_lock<std::mutex> lk(cam.mutex);
-    cam.cv_sent.wait(lk, [&] { return !cam.pending; });
-    cam.fr = fr;
-    cam.event = event;
-    cam.pending = true;
+    ++cam.dropped;
+    ++cam.done;
+  }
+  cam.cv_sent.notify_all();
+}
+
+void CameraServer::discardQueued() {
+  for (auto &cam : cameras_) {
+    FrameRequest request;
+    while (cam.queue->pop(request)) {
+      request = {};
+      std::unique_lock<std::mutex> lk(cam.mutex);
+      ++cam.done;
+    }
   }
-  cam.cv_ready.notify_one();  // Wake up consumer
+  waitForSent();
 }
 
 void CameraServer::waitForSent() {
   for (auto &cam : cameras_) {
     std::unique_lock<std::mutex> lk(cam.mutex);
-    cam.cv_sent.wait(lk, [&] { return !cam.pending; });
+    cam.cv_sent.wait(lk, [&] { return cam.done == cam.pushed; });
   }
 }
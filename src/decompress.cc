@@ -91,3 +91,15 @@ std::string decompressZST(const std::byte* in, size_t in_size, std::atomic<bool>
   }
   return {};
 }
+
+std::string compressZST(const std::byte* in, size_t in_size, int level) {
+  std::string out(ZSTD_compressBound(in_size), '\0');
+  size_t result = ZSTD_compress(out.data(), out.size(), in, in_size, level);
+  if (ZSTD_isError(result)) {
+    rWarning("compressZST error: %s", ZSTD_getErrorName(result));
+    return {};
+  }
+  out.resize(result);
+  out.shrink_to_fit();
+  return out;
+}
@@ -0,0 +1,63 @@
+#include "event_index.h"
+
+#include <algorithm>
+
+void EventIndex::addChunk(int seg_num, const Event *begin, const Event *end) {
+  if (begin == end) return;
+
+  auto it = std::upper_bound(chunks_.begin(), chunks_.end(), *begin,
+                             [](const Event &e, const Chunk &c) { return e < *c.begin; });
+  chunks_.insert(it, Chunk{seg_num, begin, end});
+  size_ += end - begin;
+}
+
+EventIndex::Cursor EventIndex::begin() const {
+  std::vector<const Event *> positions;
+  positions.reserve(chunks_.size());
+  for (const auto &chunk : chunks_) {
+    positions.push_back(chunk.begin);
+  }
+  return Cursor(&chunks_, std::move(positions));
+}
+
+EventIndex::Cursor EventIndex::upperBound(const Event &event) const {
+  std::vector<const Event *> positions;
+  positions.reserve(chunks_.size());
+  for (const auto &chunk : chunks_) {
+    positions.push_back(std::upper_bound(chunk.begin, chunk.end, event));
+  }
+  return Cursor(&chunks_, std::move(positions));
+}
+
+// class EventIndex::Cursor
+
+EventIndex::Cursor::Cursor(const std::vector<Chunk> *chunks, std::vector<const Event *> &&positions)
+    : chunks_(chunks), positions_(std::move(positions)) {
+  selectNext();
+}
+
+EventIndex::Cursor &EventIndex::Cursor::operator++() {
+  ++positions_[current_chunk_];
+  selectNext();
+  return *this;
+}
+
+void EventIndex::Cursor::selectNext() {
+  const auto &chunks = *chunks_;
+  while (first_live_ < chunks.size() && positions_[first_live_] == chunks[first_live_].end) {
+    ++first_live_;
+  }
+
+  // Segments rarely overlap in time, so this usually stops after one or two chunks:
+  // chunks are ordered by their first event and none of the later ones can be smaller.
+  current_ = nullptr;
+  for (size_t i = first_live_; i < chunks.size(); ++i) {
+    if (current_ && *current_ < *chunks[i].begin) break;
+
+    const Event *e = positions_[i];
+    if (e != chunks[i].end && (!current_ || *e < *current_)) {
+      current_ = e;
+      current_chunk_ = i;
+    }
+  }
+}
@@ -0,0 +1,182 @@
+#include "event_ring.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include "util.h"
+
+namespace event_ring {
+
+std::string path(const std::string &name) {
+#ifdef __APPLE__
+  std::string dir = "/tmp/";
+#else
+  std::string dir = "/dev/shm/";
+#endif
+  if (const char *prefix = std::getenv("OPENPILOT_PREFIX")) {
+    dir += std::string(prefix) + "/";
+  }
+  return dir + name;
+}
+
+inline uint64_t recordSize(size_t message_size) {
+  return (sizeof(RecordHeader) + message_size + 7) & ~7ull;
+}
+
+}  // namespace event_ring
+
+using namespace event_ring;
+
+EventRingWriter::EventRingWriter(const std::string &name, size_t capacity) : path_(event_ring::path(name)) {
+  capacity_ = 4096;
+  while (capacity_ < capacity) capacity_ <<= 1;
+  map_size_ = sizeof(Header) + capacity_;
+
+  int fd = ::open(path_.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0664);
+  if (fd < 0 || ftruncate(fd, map_size_) != 0) {
+    rWarning("failed to create event ring %s: %s", path_.c_str(), strerror(errno));
+    if (fd >= 0) close(fd);
+    return;
+  }
+  void *mem = mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mem == MAP_FAILED) {
+    rWarning("failed to map event ring %s: %s", path_.c_str(), strerror(errno));
+    return;
+  }
+
+  header_ = new (mem) Header{};
+  header_->version = VERSION;
+  header_->capacity = capacity_;
+  data_ = (char *)mem + sizeof(Header);
+  // Readers only attach once the magic is visible
+  std::atomic_thread_fence(std::memory_order_release);
+  header_->magic = MAGIC;
+  rInfo("writing events to %s (%s)", path_.c_str(), formattedDataSize(capacity_).c_str());
+}
+
+EventRingWriter::~EventRingWriter() {
+  if (header_) {
+    munmap(header_, map_size_);
+    unlink(path_.c_str());  // Attached readers keep their mapping
+  }
+}
+
+bool EventRingWriter::write(const Event &e) {
+  if (!header_) return false;
+
+  const size_t size = e.data.size() * sizeof(capnp::word);
+  const uint64_t record_size = recordSize(size);
+  if (record_size > capacity_) return false;
+
+  uint64_t at = offset_ & (capacity_ - 1);
+  const uint64_t padding = at + record_size > capacity_ ? capacity_ - at : 0;
+
+  // Readers holding a view of the bytes about to be overwritten see it as invalid from here on
+  header_->reserve_offset.store(offset_ + padding + record_size, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  if (padding > 0) {
+    // Pad the tail, readers skip it. A tail too short for a header is skipped implicitly.
+    if (padding >= sizeof(RecordHeader)) {
+      auto pad = (RecordHeader *)(data_ + at);
+      pad->size = padding - sizeof(RecordHeader);
+      pad->which = PADDING;
+    }
+    offset_ += padding;
+    at = 0;
+  }
+
+  auto record = (RecordHeader *)(data_ + at);
+  record->size = size;
+  record->which = e.which;
+  record->mono_time = e.mono_time;
+  record->seq = ++seq_;
+  memcpy(record + 1, e.data.begin(), size);
+
+  offset_ += record_size;
+  header_->write_offset.store(offset_, std::memory_order_release);
+  header_->write_seq.store(seq_, std::memory_order_release);
+  return true;
+}
+
+// class EventRingReader
+
+EventRingReader::~EventRingReader() {
+  if (header_) munmap((void *)header_, map_size_);
+}
+
+bool EventRingReader::open(const std::string &name) {
+  const std::string file = event_ring::path(name);
+  int fd = ::open(file.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+
+  // The leading plain fields of Header
+  struct {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t capacity;
+  } header;
+  bool ok = pread(fd, &header, sizeof(header), 0) == sizeof(header) && header.magic == MAGIC && header.version == VERSION;
+  if (ok) {
+    map_size_ = sizeof(Header) + header.capacity;
+    void *mem = mmap(nullptr, map_size_, PROT_READ, MAP_SHARED, fd, 0);
+    if ((ok = mem != MAP_FAILED)) {
+      header_ = (const Header *)mem;
+      data_ = (const char *)mem + sizeof(Header);
+      capacity_ = header.capacity;
+      resync();
+    }
+  }
+  close(fd);
+  return ok;
+}
+
+// Continue from the writer's current position, counting the skipped events as lost
+void EventRingReader::resync() {
+  pos_ = header_->write_offset.load(std::memory_order_acquire);
+  uint64_t seq = header_->write_seq.load(std::memory_order_acquire);
+  if (last_seq_ > 0 && seq > last_seq_) lost_ += seq - last_seq_;
+  last_seq_ = seq;
+}
+
+bool EventRingReader::next(View &view) {
+  while (true) {
+    const uint64_t end = header_->write_offset.load(std::memory_order_acquire);
+    if (pos_ >= end) return false;
+
+    const uint64_t at = pos_ & (capacity_ - 1);
+    if (capacity_ - at < sizeof(RecordHeader)) {
+      pos_ += capacity_ - at;
+      continue;
+    }
+
+    const RecordHeader record = *(const RecordHeader *)(data_ + at);
+    // The header may have been overwritten while it was copied
+    if (!valid(pos_) || at + recordSize(record.size) > capacity_) {
+      resync();
+      continue;
+    }
+    if (record.which == PADDING) {
+      pos_ += capacity_ - at;
+      continue;
+    }
+
+    if (record.seq > last_seq_ + 1 && last_seq_ > 0) lost_ += record.seq - last_seq_ - 1;
+    last_seq_ = record.seq;
+
+    view.which = record.which;
+    view.mono_time = record.mono_time;
+    view.seq = record.seq;
+    view.data = kj::arrayPtr((const capnp::word *)(data_ + at + sizeof(RecordHeader)), record.size / sizeof(capnp::word));
+    view.pos = pos_;
+    pos_ += recordSize(record.size);
+    return true;
+  }
+}
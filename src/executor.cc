@@ -0,0 +1,139 @@
+#include "executor.h"
+
+#include <algorithm>
+
+#include "common/util.h"
+
+TaskExecutor::TaskExecutor(int num_threads) {
+  num_threads = std::max(1, num_threads);
+  for (int i = 0; i < num_threads; ++i) {
+    workers_.emplace_back(std::make_unique<Worker>());
+  }
+  for (int i = 0; i < num_threads; ++i) {
+    workers_[i]->thread = std::thread(&TaskExecutor::workerThread, this, i);
+  }
+}
+
+TaskExecutor::~TaskExecutor() {
+  {
+    std::lock_guard lock(sleep_mutex_);
+    exit_ = true;
+  }
+  sleep_cv_.notify_all();
+  for (auto &worker : workers_) {
+    worker->thread.join();
+  }
+}
+
+TaskExecutor &TaskExecutor::instance() {
+  static TaskExecutor executor(default_thread_count_ > 0 ? default_thread_count_
+                                                         : std::clamp<int>(std::thread::hardware_concurrency(), 4, 8));
+  return executor;
+}
+
+void TaskExecutor::setDefaultThreadCount(int n) {
+  default_thread_count_ = n;
+}
+
+void TaskExecutor::submit(Task task, TaskPriority priority) {
+  {
+    std::lock_guard lock(sleep_mutex_);
+    ++queued_;  // counted before it is visible, so that purge and pop never underflow
+  }
+  auto &worker = workers_[next_worker_++ % workers_.size()];
+  {
+    std::lock_guard lock(worker->mutex);
+    worker->queues[(int)priority].push_back(std::move(task));
+  }
+  sleep_cv_.notify_one();
+}
+
+size_t TaskExecutor::purge(TaskGroup *group) {
+  size_t removed = 0;
+  for (auto &worker : workers_) {
+    std::lock_guard lock(worker->mutex);
+    for (auto &queue : worker->queues) {
+      auto it = std::remove_if(queue.begin(), queue.end(), [group](const Task &t) { return t.group == group; });
+      removed += std::distance(it, queue.end());
+      queue.erase(it, queue.end());
+    }
+  }
+  queued_ -= removed;
+  return removed;
+}
+
+bool TaskExecutor::popTask(int worker_id, Task &task) {
+  for (int p = 0; p < (int)TaskPriority::Count; ++p) {
+    // Own queue first, then steal from the other workers
+    for (size_t i = 0; i < workers_.size(); ++i) {
+      auto &worker = workers_[(worker_id + i) % workers_.size()];
+      std::lock_guard lock(worker->mutex);
+      auto &queue = worker->queues[p];
+      if (!queue.empty()) {
+        if (i == 0) {
+          task = std::move(queue.front());
+          queue.pop_front();
+        } else {
+          task = std::move(queue.back());
+          queue.pop_back();
+        }
+        --queued_;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void TaskExecutor::workerThread(int worker_id) {
+  util::set_thread_name("replay_worker");
+  while (true) {
+    {
+      std::unique_lock lock(sleep_mutex_);
+      sleep_cv_.wait(lock, [this]() { return exit_ || queued_ > 0; });
+      if (exit_) break;
+    }
+
+    Task task;
+    if (popTask(worker_id, task)) {
+      if (!task.group->cancelled()) {
+        task.fn();
+      }
+      task.group->finished();
+    }
+  }
+}
+
+// class TaskGroup
+
+TaskGroup::~TaskGroup() {
+  cancel();
+  wait();
+}
+
+void TaskGroup::submit(std::function<void()> fn, TaskPriority priority) {
+  {
+    std::lock_guard lock(mutex_);
+    ++pending_;
+  }
+  executor_.submit({std::move(fn), this}, priority);
+}
+
+void TaskGroup::cancel() {
+  cancelled_ = true;
+  if (size_t removed = executor_.purge(this)) {
+    finished(removed);
+  }
+}
+
+void TaskGroup::wait() {
+  std::unique_lock lock(mutex_);
+  cv_.wait(lock, [this]() { return pending_ == 0; });
+}
+
+void TaskGroup::finished(size_t count) {
+  // Notify under the lock: the group may be destroyed as soon as wait() returns
+  std::lock_guard lock(mutex_);
+  pending_ -= count;
+  cv_.notify_all();
+}
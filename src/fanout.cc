@@ -0,0 +1,129 @@
+#include "fanout.h"
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <optional>
+
+#include "common/params.h"
+#include "common/util.h"
+#include "msgq/visionipc/visionbuf.h"
+#include "util.h"
+
+// Params directories of the fan-out namespaces, resolved at startup
+static std::mutex param_paths_lock;
+static std::map<std::string, std::string> param_paths;
+
+static std::string msgqDir(const char *prefix) {
+#ifdef __APPLE__
+  std::string dir = "/tmp/";
+#else
+  std::string dir = "/dev/shm/";
+#endif
+  return prefix ? dir + "msgq_" + prefix + "/" : dir;
+}
+
+// Same as get_ipc_path() in VisionIpc
+static std::string vipcPath(const char *prefix, const std::string &name) {
+  std::string path = "/tmp/";
+  if (prefix) path += std::string(prefix) + "_";
+  return path + "visionipc_" + name;
+}
+
+// Same as get_endpoint_name() in VisionIpc
+static std::string vipcEndpoint(const std::string &name, VisionStreamType type) {
+  return "visionipc_" + name + "_" + std::to_string(type);
+}
+
+static bool linkPath(const std::string &target, const std::string &path) {
+  unlink(path.c_str());
+  if (symlink(target.c_str(), path.c_str()) != 0) {
+    rWarning("failed to link %s to %s", path.c_str(), target.c_str());
+    return false;
+  }
+  return true;
+}
+
+std::string fanoutEndpoint(const std::string &prefix, const std::string &name) {
+  return (std::getenv("OPENPILOT_PREFIX") ? "../msgq_" : "msgq_") + prefix + "/" + name;
+}
+
+std::string fanoutVipcName(const std::string &prefix) {
+  return "camerad_fanout_" + prefix;
+}
+
+bool putFanoutParam(const std::string &prefix, const std::string &key, const std::string &value) {
+  std::string param_path;
+  {
+    std::lock_guard lk(param_paths_lock);
+    auto it = param_paths.find(prefix);
+    if (it == param_paths.end()) return false;
+    param_path = it->second;
+  }
+
+  // Write next to the namespace's directory and rename into it, as Params::put() does
+  std::string tmp_path = param_path.substr(0, param_path.rfind('/')) + "/.tmp_value_XXXXXX";
+  int fd = mkstemp((char *)tmp_path.c_str());
+  if (fd < 0) {
+    rWarning("failed to write %s to %s", key.c_str(), param_path.c_str());
+    return false;
+  }
+  bool ok = HANDLE_EINTR(write(fd, value.data(), value.size())) == (ssize_t)value.size();
+  close(fd);
+  ok = ok && rename(tmp_path.c_str(), (param_path + "/" + key).c_str()) == 0;
+  if (!ok) {
+    rWarning("failed to write %s to %s", key.c_str(), param_path.c_str());
+    unlink(tmp_path.c_str());
+  }
+  return ok;
+}
+
+FanoutPrefix::FanoutPrefix(const std::string &prefix) : prefix_(prefix) {
+  msgq_path_ = msgqDir(prefix_.c_str());
+  if (!util::create_directories(msgq_path_, 0777)) {
+    rWarning("failed to create %s", msgq_path_.c_str());
+  }
+
+  // Params takes the namespace from the environment, safe to switch as no other thread runs yet
+  std::optional<std::string> own_prefix;
+  if (const char *p = std::getenv("OPENPILOT_PREFIX")) own_prefix = p;
+  setenv("OPENPILOT_PREFIX", prefix_.c_str(), 1);
+  param_path_ = Params().getParamPath();
+  if (own_prefix) {
+    setenv("OPENPILOT_PREFIX", own_prefix->c_str(), 1);
+  } else {
+    unsetenv("OPENPILOT_PREFIX");
+  }
+  {
+    std::lock_guard lk(param_paths_lock);
+    param_paths[prefix_] = param_path_;
+  }
+
+  // VisionIpc clients in the namespace reach the fan-out server through its socket and
+  // buffer queues, which live in this process's namespace under fanoutVipcName()
+  const char *own = own_prefix ? own_prefix->c_str() : nullptr;
+  const std::string server = fanoutVipcName(prefix_);
+  vipc_path_ = vipcPath(prefix_.c_str(), "camerad");
+  linkPath(vipcPath(own, server), vipc_path_);
+  for (auto type : {VISION_STREAM_ROAD, VISION_STREAM_DRIVER, VISION_STREAM_WIDE_ROAD}) {
+    linkPath(msgqDir(own) + vipcEndpoint(server, type), msgq_path_ + vipcEndpoint("camerad", type));
+  }
+  rInfo("fan-out to prefix %s", prefix_.c_str());
+}
+
+FanoutPrefix::~FanoutPrefix() {
+  {
+    std::lock_guard lk(param_paths_lock);
+    param_paths.erase(prefix_);
+  }
+  if (util::file_exists(param_path_)) {
+    std::string real_path = util::readlink(param_path_);
+    system(util::string_format("rm %s -rf", real_path.c_str()).c_str());
+    unlink(param_path_.c_str());
+  }
+  unlink(vipc_path_.c_str());
+  system(util::string_format("rm %s -rf", msgq_path_.c_str()).c_str());
+}
@@ -1,5 +1,6 @@
 #include "framereader.h"
 
+#include <atomic>
 #include <map>
 #include <memory>
 #include <tuple>
@@ -62,7 +63,9 @@ DecoderManager decoder_manager;
 
 }  // namespace
 
-FrameReader::FrameReader() {
+static std::atomic<uint64_t> next_reader_id = 1;
+
+FrameReader::FrameReader() : id_(next_reader_id++) {
   av_log_set_level(AV_LOG_QUIET);
 }
 
@@ -81,7 +84,7 @@ bool FrameReader::load(CameraType type, const std::string &url, bool no_hw_decod
   return loadFromFile(type, local_file_path, no_hw_decoder, abort);
 }
 
-bool FrameReader::loadFromFile(CameraType type, const std::string &file, bool no_hw_decoder, std::atomic<bool> *abort) {
+bool FrameReader::openInput(const std::string &file) {
   if (avformat_open_input(&input_ctx, file.c_str(), nullptr, nullptr) != 0 ||
       avformat_find_stream_info(input_ctx, nullptr) < 0) {
     rError("Failed to open input file or find video stream");
@@ -94,6 +97,13 @@ bool FrameReader::loadFromFile(CameraType type, const std::string &file, bool no
     rError("No video stream found in file");
     return false;
   }
+  return true;
+}
+
+bool FrameReader::loadFromFile(CameraType type, const std::string &file, bool no_hw_decoder, std::atomic<bool> *abort) {
+  if (!openInput(file)) {
+    return false;
+  }
 
   decoder_ = decoder_manager.acquire(type, input_ctx->streams[video_stream_idx_]->codecpar, !no_hw_decoder);
   if (!decoder_) {
@@ -121,8 +131,40 @@ bool FrameReader::get(int idx, VisionBuf *buf) {
   return decoder_->decode(this, idx, buf);
 }
 
+bool FrameReader::isKeyFrame(int idx) const {
+  return packets_info[idx].flags & AV_PKT_FLAG_KEY;
+}
+
+int FrameReader::keyFrameIndex(int idx) const {
+  for (int i = idx; i >= 0; --i) {
+    if (isKeyFrame(i)) return i;
+  }
+  return idx;
+}
+
+size_t FrameReader::memoryUsage() const {
+  // Decoders are shared between segments, count the demuxer and the packet index
+  size_t io_buffer = (input_ctx && input_ctx->pb) ? input_ctx->pb->buffer_size : 0;
+  return sizeof(FrameReader) + io_buffer + packets_info.capacity() * sizeof(PacketInfo);
+}
+
 // class VideoDecoder
 
+std::pair<int, bool> VideoDecoder::startFrame(FrameReader *reader, int idx) {
+  const bool continuous = reader->id() == last_reader_;
+  last_reader_ = reader->id();
+  if (continuous && idx == reader->prev_idx + 1) {
+    return {idx, false};
+  }
+
+  const int key_idx = reader->keyFrameIndex(idx);
+  if (continuous && key_idx <= reader->prev_idx && reader->prev_idx < idx) {
+    // The target is further into the GOP being decoded, continue rather than restart at its key frame
+    return {reader->prev_idx + 1, false};
+  }
+  return {key_idx, true};
+}
+
 FFmpegVideoDecoder::FFmpegVideoDecoder() {
   av_frame_ = av_frame_alloc();
   hw_frame_ = av_frame_alloc();
@@ -186,16 +228,8 @@ bool FFmpegVideoDecoder::initHardwareDecoder(AVHWDeviceType hw_device_type) {
 }
 
 bool FFmpegVideoDecoder::decode(FrameReader *reader, int idx, VisionBuf *buf) {
-  int current_idx = idx;
-  if (idx != reader->prev_idx + 1) {
-    // seeking to the nearest key frame
-    for (int i = idx; i >= 0; --i) {
-      if (reader->packets_info[i].flags & AV_PKT_FLAG_KEY) {
-        current_idx = i;
-        break;
-      }
-    }
-
+  auto [current_idx, seek] = startFrame(reader, idx);
+  if (seek) {
     auto pos = reader->packets_info[current_idx].pos;
     int ret = avformat_seek_file(reader->input_ctx, 0, pos, pos, pos, AVSEEK_FLAG_BYTE);
     if (ret < 0) {
@@ -283,16 +317,8 @@ bool QcomVideoDecoder::open(AVCodecParameters *codecpar, bool hw_decoder) {
 }
 
 bool QcomVideoDecoder::decode(FrameReader *reader, int idx, VisionBuf *buf) {
-  int from_idx = idx;
-  if (idx != reader->prev_idx + 1) {
-    // seeking to the nearest key frame
-    for (int i = idx; i >= 0; --i) {
-      if (reader->packets_info[i].flags & AV_PKT_FLAG_KEY) {
-        from_idx = i;
-        break;
-      }
-    }
-
+  auto [from_idx, seek] = startFrame(reader, idx);
+  if (seek) {
     auto pos = reader->packets_info[from_idx].pos;
     int ret = avformat_seek_file(reader->input_ctx, 0, pos, pos, pos, AVSEEK_FLAG_BYTE);
     if (ret < 0) {
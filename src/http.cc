@@ -135,6 +135,55 @@ size_t getRemoteFileSize(const std::string& url, std::atomic<bool>* abort) {
   return content_length > 0 ? (size_t)content_length : 0;
 }
 
+std::vector<bool> remoteFilesExist(const std::vector<std::string>& urls, std::atomic<bool>* abort) {
+  std::vector<bool> exists(urls.size(), false);
+  CURLM* cm = curl_multi_init();
+  curl_multi_setopt(cm, CURLMOPT_MAX_TOTAL_CONNECTIONS, 16L);
+
+  std::vector<CURL*> handles;
+  handles.reserve(urls.size());
+  for (size_t i = 0; i < urls.size(); ++i) {
+    CURL* eh = curl_easy_init();
+    handles.push_back(eh);
+    curl_easy_setopt(eh, CURLOPT_URL, urls[i].c_str());
+    curl_easy_setopt(eh, CURLOPT_WRITEFUNCTION, dumy_write_cb);
+    curl_easy_setopt(eh, CURLOPT_NOBODY, 1L);
+    curl_easy_setopt(eh, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(eh, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(eh, CURLOPT_CONNECTTIMEOUT_MS, 2000L);
+    curl_easy_setopt(eh, CURLOPT_TIMEOUT_MS, 5000L);
+    curl_easy_setopt(eh, CURLOPT_PRIVATE, (void*)i);
+    curl_multi_add_handle(cm, eh);
+  }
+
+  int still_running = 1;
+  while (still_running > 0 && !(abort && *abort)) {
+    if (curl_multi_perform(cm, &still_running) != CURLM_OK) break;
+    if (still_running > 0) {
+      curl_multi_wait(cm, nullptr, 0, 500, nullptr);
+    }
+  }
+
+  int msgs_left = -1;
+  CURLMsg* msg;
+  while ((msg = curl_multi_info_read(cm, &msgs_left))) {
+    if (msg->msg != CURLMSG_DONE || msg->data.result != CURLE_OK) continue;
+
+    long code = 0;
+    void* idx = nullptr;
+    curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE, &code);
+    curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &idx);
+    exists[(size_t)idx] = (code == 200);
+  }
+
+  for (CURL* eh : handles) {
+    curl_multi_remove_handle(cm, eh);
+    curl_easy_cleanup(eh);
+  }
+  curl_multi_cleanup(cm);
+  return exists;
+}
+
 std::string getUrlWithoutQuery(const std::string& url) {
   size_t idx = url.find("?");
   return (idx == std::string::npos ? url : url.substr(0, idx));
@@ -1,8 +1,10 @@
 #include "logreader.h"
 
 #include <algorithm>
+#include <unordered_map>
 #include <utility>
 
+#include "common/timing.h"
 #include "common/util.h"
 #include "decompress.h"
 #include "filereader.h"
@@ -12,7 +14,9 @@ const std::string BZ2_MAGIC = "BZh9";
 const std::string ZST_MAGIC = "\x28\xB5\x2F\xFD";
 
 bool LogReader::load(const std::string& url, bool low_memory, std::atomic<bool>* abort, bool local_cache, int chunk_size, int retries) {
+  double t = millis_since_boot();
   std::string data = FileReader(local_cache, chunk_size, retries).read(url, abort);
+  timings.read = millis_since_boot() - t;
   if (data.empty()) return false;
 
   // Decompress based on file extension or magic bytes
@@ -21,6 +25,7 @@ bool LogReader::load(const std::string& url, bool low_memory, std::atomic<bool>*
   } else if (url.find(".zst") != std::string::npos || util::starts_with(data, ZST_MAGIC)) {
     data = decompressZST(data, abort);
   }
+  timings.decompress = millis_since_boot() - t - timings.read;
 
   if (data.empty()) return false;
 
@@ -34,6 +39,7 @@ bool LogReader::load(const std::string& url, bool low_memory, std::atomic<bool>*
 }
 
 bool LogReader::load(const char *data, size_t size, bool low_memory, std::atomic<bool> *abort) {
+  double t = millis_since_boot();
   try {
     events.reserve(65000);
     kj::ArrayPtr<const capnp::word> words((const capnp::word *)data, size / sizeof(capnp::word));
@@ -86,12 +92,58 @@ bool LogReader::load(const char *data, size_t size, bool low_memory, std::atomic
 
   if (!events.empty() && !(abort && *abort)) {
     events.shrink_to_fit();
+    double sort_start = millis_since_boot();
     std::sort(events.begin(), events.end());
+    timings.parse = sort_start - t;
+    timings.sort = millis_since_boot() - sort_start;
+    timings.finished_ts = nanos_since_boot();
     return true;
   }
   return false;
 }
 
+bool LogReader::load(const CompressedLog &log, std::atomic<bool> *abort) {
+  double t = millis_since_boot();
+  raw_log_data_ = decompressZST(log.data, abort);
+  timings.decompress = millis_since_boot() - t;
+  if (raw_log_data_.size() != log.raw_size) return false;
+
+  const capnp::word *words = (const capnp::word *)raw_log_data_.data();
+  events.reserve(log.index.size());
+  for (const auto &e : log.index) {
+    events.emplace_back(e.which, e.mono_time, kj::arrayPtr(words + e.offset, e.size), e.eidx_segnum);
+  }
+  timings.parse = millis_since_boot() - t - timings.decompress;
+  timings.finished_ts = nanos_since_boot();
+  return !events.empty();
+}
+
+std::unique_ptr<CompressedLog> LogReader::compress(std::atomic<bool> *abort) const {
+  auto log = std::make_unique<CompressedLog>();
+  log->index.reserve(events.size());
+
+  // Events may share their data (encodeIdx frame packets), store it once
+  std::string raw;
+  std::unordered_map<const capnp::word *, uint32_t> offsets;
+  for (const auto &evt : events) {
+    if (abort && *abort) return nullptr;
+
+    auto [it, inserted] = offsets.try_emplace(evt.data.begin(), raw.size() / sizeof(capnp::word));
+    if (inserted) {
+      raw.append((const char *)evt.data.begin(), evt.data.size() * sizeof(capnp::word));
+    }
+    log->index.push_back({evt.mono_time, evt.which, evt.eidx_segnum, it->second, (uint32_t)evt.data.size()});
+  }
+
+  log->raw_size = raw.size();
+  log->data = compressZST((const std::byte *)raw.data(), raw.size());
+  return log->data.empty() ? nullptr : std::move(log);
+}
+
+size_t LogReader::memoryUsage() const {
+  return raw_log_data_.capacity() + buffer_.allocatedSize() + events.capacity() * sizeof(Event);
+}
+
 void LogReader::migrateOldEvents() {
   size_t events_size = events.size();
   for (int i = 0; i < events_size; ++i) {
@@ -1,5 +1,6 @@
 #include <getopt.h>
 
+#include <algorithm>
 #include <iostream>
 #include <map>
 #include <string>
@@ -7,6 +8,10 @@
 
 #include "common/prefix.h"
 #include "consoleui.h"
+#include "executor.h"
+#include "fanout.h"
+#include "msgq/ipc.h"
+#include "playlist.h"
 #include "replay.h"
 #include "util.h"
 
@@ -16,13 +21,22 @@ Options:
   -a, --allow        Whitelist of services to send (comma-separated)
   -b, --block        Blacklist of services to send (comma-separated)
   -c, --cache        Cache <n> segments in memory. Default is 5
+      --cache-mem    Size the segment cache to <MB> of memory instead of a segment count
+      --mem-reserve  Shrink the cache to keep <MB> of system memory available
+      --warm-cache   Keep up to <MB> of evicted segments compressed in memory. Default is 256
   -s, --start        Start from <seconds>
   -x, --playback     Playback <speed>
       --demo         Use a demo route instead of providing your own
       --auto         Auto load the route from the best available source (no video):
-                     internal, openpilotci, comma_api, car_segments, testing_closet
+                     internal, openpilotci, comma_api, car_segments, testing_closet, local
   -d, --data_dir     Local directory with routes
   -p, --prefix       Set OPENPILOT_PREFIX
+      --playlist     Replay the routes listed in <file> ("-" for stdin) back-to-back, without UI
+      --fanout       Also publish into the OPENPILOT_PREFIX <prefix>, can be repeated
+      --event-ring   Also write all published events to the shm ring /dev/shm/[prefix/]<name>
+      --event-ring-size Size of the event ring in MB. Default is 64
+      --plugin       Load an in-process consumer from <path[:args]>, can be repeated
+      --no-msgq      Deliver messages only to the event ring and plugins, not to msgq (video is still sent)
       --dcam         Load driver camera
       --ecam         Load wide road camera
       --no-loop      Stop at the end of the route
@@ -30,7 +44,18 @@ Options:
       --qcam         Load qcamera
       --no-hw-decoder Disable HW video decoding
       --no-vipc      Do not output video
+      --max-throughput Publish as fast as the readers consume, ignoring the playback speed
       --all          Output all messages including bookmarkButton, uiDebug, userBookmark
+      --batch        Publish events due within <us> of each other together. Default is 1000
+      --no-decimate  Services never decimated at high speed (comma-separated), in addition to the encode
+                     indices and services of 1 Hz or less. "all" to disable decimation
+      --rate-limit   Publish rate caps as service=hz (comma-separated). Default is the services.py frequency
+      --publishers   Publish from <n> threads sharded by service. Default is 0, the stream thread
+      --decode-ahead Decode up to <n> frames ahead per camera (1-20). Default is 4
+      --frame-queue  Queue up to <n> frames per camera before --frame-policy applies. Default is 4
+      --frame-policy When a frame queue is full: drop-oldest (default), block or latest
+      --no-frame-skip Decode every frame, even when decoding falls behind the playback speed
+      --threads      Number of worker threads loading segments. Default is 4-8 by CPU count
   -h, --help         Show this help message
 )";
 
@@ -45,6 +70,12 @@ bool parseArgs(int argc, char *argv[], ReplayConfig &config) {
       {"auto", no_argument, nullptr, 0},
       {"data_dir", required_argument, nullptr, 'd'},
       {"prefix", required_argument, nullptr, 'p'},
+      {"fanout", required_argument, nullptr, 0},
+      {"playlist", required_argument, nullptr, 0},
+      {"event-ring", required_argument, nullptr, 0},
+      {"event-ring-size", required_argument, nullptr, 0},
+      {"plugin", required_argument, nullptr, 0},
+      {"no-msgq", no_argument, nullptr, 0},
       {"dcam", no_argument, nullptr, 0},
       {"ecam", no_argument, nullptr, 0},
       {"no-loop", no_argument, nullptr, 0},
@@ -53,6 +84,19 @@ bool parseArgs(int argc, char *argv[], ReplayConfig &config) {
       {"no-hw-decoder", no_argument, nullptr, 0},
       {"no-vipc", no_argument, nullptr, 0},
       {"all", no_argument, nullptr, 0},
+      {"max-throughput", no_argument, nullptr, 0},
+      {"threads", required_argument, nullptr, 0},
+      {"batch", required_argument, nullptr, 0},
+      {"publishers", required_argument, nullptr, 0},
+      {"decode-ahead", required_argument, nullptr, 0},
+      {"frame-queue", required_argument, nullptr, 0},
+      {"frame-policy", required_argument, nullptr, 0},
+      {"no-frame-skip", no_argument, nullptr, 0},
+      {"no-decimate", required_argument, nullptr, 0},
+      {"rate-limit", required_argument, nullptr, 0},
+      {"cache-mem", required_argument, nullptr, 0},
+      {"mem-reserve", required_argument, nullptr, 0},
+      {"warm-cache", required_argument, nullptr, 0},
       {"help", no_argument, nullptr, 'h'},
       {nullptr, 0, nullptr, 0},  // Terminating entry
   };
@@ -65,6 +109,9 @@ bool parseArgs(int argc, char *argv[], ReplayConfig &config) {
       {"qcam", REPLAY_FLAG_QCAMERA},
       {"no-hw-decoder", REPLAY_FLAG_NO_HW_DECODER},
       {"no-vipc", REPLAY_FLAG_NO_VIPC},
+      {"max-throughput", REPLAY_FLAG_MAX_THROUGHPUT},
+      {"no-msgq", REPLAY_FLAG_NO_MSGQ},
+      {"no-frame-skip", REPLAY_FLAG_NO_FRAME_SKIP},
       {"all", REPLAY_FLAG_ALL_SERVICES},
   };
 
@@ -92,6 +139,43 @@ bool parseArgs(int argc, char *argv[], ReplayConfig &config) {
         std::string name = cli_options[option_index].name;
         if (name == "demo") config.route = DEMO_ROUTE;
         else if (name == "auto") config.auto_source = true;
+        else if (name == "threads") config.worker_threads = std::atoi(optarg);
+        else if (name == "batch") config.publish_batch_us = std::atoi(optarg);
+        else if (name == "publishers") config.publisher_threads = std::atoi(optarg);
+        else if (name == "decode-ahead") config.decode_ahead = std::atoi(optarg);
+        else if (name == "frame-queue") config.frame_queue = std::atoi(optarg);
+        else if (name == "frame-policy") {
+          static const std::map<std::string, FrameQueuePolicy> policies = {
+              {"drop-oldest", FrameQueuePolicy::DropOldest},
+              {"block", FrameQueuePolicy::Block},
+              {"latest", FrameQueuePolicy::Latest},
+          };
+          auto policy = policies.find(optarg);
+          if (policy == policies.end()) {
+            std::cerr << "invalid frame policy: " << optarg << std::endl;
+            return false;
+          }
+          config.frame_policy = policy->second;
+        }
+        else if (name == "event-ring") config.event_ring = optarg;
+        else if (name == "fanout") config.fanout_prefixes.push_back(optarg);
+        else if (name == "playlist") config.playlist = optarg;
+        else if (name == "plugin") config.plugins.push_back(optarg);
+        else if (name == "event-ring-size") config.event_ring_size = std::max(1, std::atoi(optarg)) * 1024ul * 1024ul;
+        else if (name == "no-decimate") config.no_decimate = split_to_set(optarg);
+        else if (name == "rate-limit") {
+          for (const auto &limit : split(optarg, ',')) {
+            auto pos = limit.find('=');
+            if (pos == std::string::npos) {
+              std::cerr << "invalid rate limit: " << limit << std::endl;
+              return false;
+            }
+            config.rate_limits[limit.substr(0, pos)] = std::atof(limit.substr(pos + 1).c_str());
+          }
+        }
+        else if (name == "cache-mem") config.cache_memory = std::max(0, std::atoi(optarg)) * 1024ul * 1024ul;
+        else if (name == "mem-reserve") config.mem_reserve = std::max(0, std::atoi(optarg)) * 1024ul * 1024ul;
+        else if (name == "warm-cache") config.warm_cache_memory = std::max(0, std::atoi(optarg)) * 1024ul * 1024ul;
         else config.flags |= flag_map.at(name);
         break;
       }
@@ -105,11 +189,28 @@ bool parseArgs(int argc, char *argv[], ReplayConfig &config) {
     config.route = argv[optind];
   }
 
-  if (config.route.empty()) {
+  if (config.route.empty() && config.playlist.empty()) {
     std::cerr << "No route provided. Use --help for usage information.\n";
     return false;
   }
 
+  if ((config.flags & REPLAY_FLAG_NO_MSGQ) && config.event_ring.empty() && config.plugins.empty()) {
+    std::cerr << "--no-msgq requires --event-ring or --plugin.\n";
+    return false;
+  }
+
+  for (const auto &prefix : config.fanout_prefixes) {
+    if (prefix.empty() || prefix == config.prefix ||
+        std::count(config.fanout_prefixes.begin(), config.fanout_prefixes.end(), prefix) > 1) {
+      std::cerr << "--fanout prefixes must be unique and differ from --prefix.\n";
+      return false;
+    }
+  }
+  if (!config.fanout_prefixes.empty() && messaging_use_zmq()) {
+    std::cerr << "--fanout requires msgq.\n";
+    return false;
+  }
+
   return true;
 }
 
@@ -129,6 +230,10 @@ int main(int argc, char *argv[]) {
   if (!config.prefix.empty()) {
     op_prefix = std::make_unique<OpenpilotPrefix>(config.prefix);
   }
+  std::vector<std::unique_ptr<FanoutPrefix>> fanout_prefixes;
+  for (const auto &prefix : config.fanout_prefixes) {
+    fanout_prefixes.push_back(std::make_unique<FanoutPrefix>(prefix));
+  }
 
   // Block UI-only services by default (use --all to include them)
   if (!(config.flags & REPLAY_FLAG_ALL_SERVICES)) {
@@ -136,6 +241,16 @@ int main(int argc, char *argv[]) {
   }
 
   config.playback_speed = (config.playback_speed <= 0) ? 1.0f : config.playback_speed;
+  TaskExecutor::setDefaultThreadCount(config.worker_threads);
+
+  if (!config.playlist.empty()) {
+    Playlist playlist(config);
+    if (!playlist.load(config.playlist)) {
+      return 1;
+    }
+    return playlist.exec() == 0 ? 0 : 1;
+  }
+
   Replay replay(config);
   if (!replay.load()) {
     return 1;
@@ -0,0 +1,103 @@
+#include "metrics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+void LatencyHistogram::record(double ms) {
+  uint64_t us = std::max<int64_t>(1, std::llround(ms * 1000.0));
+  int bucket = std::clamp<int>(std::log2((double)us) * STEPS_PER_OCTAVE, 0, BUCKETS - 1);
+  buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+
+  uint64_t prev = max_us_.load(std::memory_order_relaxed);
+  while (us > prev && !max_us_.compare_exchange_weak(prev, us, std::memory_order_relaxed)) {}
+}
+
+double LatencyHistogram::percentile(double p) const {
+  const uint64_t total = count_;
+  if (total == 0) return 0;
+
+  const uint64_t rank = std::max<uint64_t>(1, std::ceil(total * p / 100.0));
+  uint64_t seen = 0;
+  for (int i = 0; i < BUCKETS; ++i) {
+    seen += buckets_[i].load(std::memory_order_relaxed);
+    if (seen >= rank) {
+      // Report the middle of the bucket, capped by the largest value recorded
+      double us = std::exp2((i + 0.5) / STEPS_PER_OCTAVE);
+      return std::min(us, (double)max_us_) / 1000.0;
+    }
+  }
+  return max();
+}
+
+std::string LatencyHistogram::summary() const {
+  char buf[128];
+  snprintf(buf, sizeof(buf), "n=%lu p50=%.1f p90=%.1f p99=%.1f max=%.1f", (unsigned long)count(),
+           percentile(50), percentile(90), percentile(99), max());
+  return buf;
+}
+
+void SeekStats::record(const SeekTimings &t) {
+  lookup.record(t.lookup);
+  ready.record(t.ready);
+  if (t.log.finished_ts > 0) {
+    queue.record(t.log.queue);
+    read.record(t.log.read);
+    decompress.record(t.log.decompress);
+    parse.record(t.log.parse);
+    sort.record(t.log.sort);
+  }
+  if (t.merge > 0) merge.record(t.merge);
+  if (t.first_frame > 0) first_frame.record(t.first_frame);
+}
+
+std::string SeekStats::summary() const {
+  std::string str;
+  const std::pair<const char *, const LatencyHistogram *> phases[] = {
+      {"lookup", &lookup}, {"queue", &queue}, {"read", &read}, {"decompress", &decompress}, {"parse", &parse},
+      {"sort", &sort}, {"merge", &merge}, {"ready", &ready}, {"first_frame", &first_frame},
+  };
+  for (const auto &[name, hist] : phases) {
+    if (hist->count() > 0) {
+      char line[160];
+      snprintf(line, sizeof(line), "  %-12s %s ms\n", name, hist->summary().c_str());
+      str += line;
+    }
+  }
+  return str;
+}
+
+void PublishStats::addService(uint16_t which, const std::string &name, float nominal_hz) {
+  if (which >= services_.size()) services_.resize(which + 1);
+  services_[which] = std::make_unique<Service>();
+  services_[which]->name = name;
+  services_[which]->nominal_hz = nominal_hz;
+}
+
+std::vector<PublishStats::Row> PublishStats::snapshot() const {
+  const double playback_seconds = playback_ns_ / 1e9;
+  std::vector<Row> rows;
+  for (const auto &s : services_) {
+    if (!s || s->lateness.count() == 0) continue;
+
+    const auto &h = s->lateness;
+    double achieved_hz = playback_seconds > 0 ? h.count() / playback_seconds : 0;
+    rows.push_back({s->name, h.count(), s->decimated, s->nominal_hz, achieved_hz, h.percentile(50), h.percentile(99), h.max()});
+  }
+  return rows;
+}
+
+std::string PublishStats::summary() const {
+  char line[256];
+  snprintf(line, sizeof(line), "  %-28s %10s %10s %8s %9s %9s %9s %9s\n", "service", "count", "decimated", "hz",
+           "achieved", "p50 ms", "p99 ms", "max ms");
+  std::string str = line;
+  for (const auto &r : snapshot()) {
+    snprintf(line, sizeof(line), "  %-28s %10lu %10lu %8.1f %9.1f %9.2f %9.2f %9.2f\n", r.name.c_str(),
+             (unsigned long)r.count, (unsigned long)r.decimated, r.nominal_hz, r.achieved_hz, r.p50, r.p99, r.max);
+    str += line;
+  }
+  snprintf(line, sizeof(line), "  resyncs: %lu\n", (unsigned long)resyncs());
+  return str + line;
+}
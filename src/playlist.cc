@@ -0,0 +1,103 @@
+#include "playlist.h"
+
+#include <condition_variable>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+
+#include "util.h"
+
+bool Playlist::load(const std::string &path) {
+  std::ifstream file;
+  if (path != "-") {
+    file.open(path);
+    if (!file) {
+      rError("failed to open playlist %s", path.c_str());
+      return false;
+    }
+  }
+  std::istream &in = path == "-" ? std::cin : file;
+
+  std::string line;
+  for (int line_num = 1; std::getline(in, line); ++line_num) {
+    line = line.substr(0, line.find('#'));
+    std::istringstream fields(line);
+    Entry entry;
+    if (!(fields >> entry.route)) continue;
+
+    std::string extra;
+    if (fields >> extra) {
+      char *end = nullptr;
+      entry.start_seconds = std::strtol(extra.c_str(), &end, 10);
+      if (*end != '\0' || entry.start_seconds < 0 || fields >> extra) {
+        rError("playlist line %d: expected \"<route> [start seconds]\"", line_num);
+        return false;
+      }
+    }
+    entries_.push_back(entry);
+  }
+
+  if (entries_.empty()) {
+    rError("playlist %s is empty", path.c_str());
+    return false;
+  }
+  return true;
+}
+
+ReplayConfig Playlist::routeConfig(size_t i) const {
+  ReplayConfig cfg = cfg_;
+  cfg.route = entries_[i].route;
+  cfg.start_seconds = entries_[i].start_seconds;
+  cfg.flags |= REPLAY_FLAG_NO_LOOP;
+  return cfg;
+}
+
+int Playlist::exec() {
+  int failed = 0;
+  std::unique_ptr<SegmentManager> next;
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    rInfo("playlist [%zu/%zu]: %s", i + 1, entries_.size(), entries_[i].route.c_str());
+    if (!play(i, std::move(next), next)) {
+      rError("failed to replay %s", entries_[i].route.c_str());
+      ++failed;
+    }
+  }
+  rInfo("playlist done, %zu routes, %d failed", entries_.size(), failed);
+  return failed;
+}
+
+bool Playlist::play(size_t i, std::unique_ptr<SegmentManager> preloaded, std::unique_ptr<SegmentManager> &next) {
+  // Declared before the replay, its callbacks may run until it is destroyed
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool finishing = false, ended = false;
+
+  const ReplayConfig cfg = routeConfig(i);
+  Replay replay(cfg, std::move(preloaded));
+  replay.onSegmentsMerged = [&]() {
+    if (replay.getEventData()->isSegmentLoaded(replay.route().segments().rbegin()->first)) {
+      std::lock_guard lock(mutex);
+      finishing = true;
+      cv.notify_one();
+    }
+  };
+  replay.onRouteEnd = [&]() {
+    std::lock_guard lock(mutex);
+    ended = true;
+    cv.notify_one();
+  };
+
+  if (!replay.load()) return false;
+  replay.start(cfg.start_seconds);
+
+  std::unique_lock lock(mutex);
+  cv.wait(lock, [&]() { return finishing || ended; });
+  if (i + 1 < entries_.size()) {
+    lock.unlock();
+    next = Replay::preloadRoute(routeConfig(i + 1));
+    lock.lock();
+  }
+  cv.wait(lock, [&]() { return ended; });
+  return true;
+}
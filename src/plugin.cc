@@ -0,0 +1,53 @@
+#include "plugin.h"
+
+#include <dlfcn.h>
+
+#include "util.h"
+
+PluginHost::~PluginHost() {
+  for (auto it = plugins_.rbegin(); it != plugins_.rend(); ++it) {
+    it->destroy(it->instance);
+    dlclose(it->handle);
+  }
+}
+
+bool PluginHost::load(const std::string &spec) {
+  const size_t pos = spec.find(':');
+  const std::string path = spec.substr(0, pos);
+  const std::string args = pos == std::string::npos ? "" : spec.substr(pos + 1);
+
+  void *handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+  if (!handle) {
+    rError("failed to load plugin %s: %s", path.c_str(), dlerror());
+    return false;
+  }
+
+  auto version = (ReplayPluginVersionFn)dlsym(handle, "replay_plugin_version");
+  auto create = (ReplayPluginCreateFn)dlsym(handle, "replay_plugin_create");
+  auto destroy = (ReplayPluginDestroyFn)dlsym(handle, "replay_plugin_destroy");
+  if (!version || !create || !destroy) {
+    rError("plugin %s does not export the replay plugin entry points", path.c_str());
+  } else if (version() != REPLAY_PLUGIN_API_VERSION) {
+    rError("plugin %s was built for API version %d, expected %d", path.c_str(), version(), REPLAY_PLUGIN_API_VERSION);
+  } else if (ReplayPlugin *instance = create(args.c_str())) {
+    plugins_.push_back({path, handle, instance, destroy});
+    rInfo("loaded plugin %s", path.c_str());
+    return true;
+  } else {
+    rError("plugin %s failed to initialize", path.c_str());
+  }
+  dlclose(handle);
+  return false;
+}
+
+void PluginHost::onEvent(const Event *event) {
+  for (auto &p : plugins_) p.instance->onEvent(event);
+}
+
+void PluginHost::onFrame(CameraType type, const VisionBuf *buf, const Event *encode_idx) {
+  for (auto &p : plugins_) p.instance->onFrame(type, buf, encode_idx);
+}
+
+void PluginHost::onSeek(double seconds) {
+  for (auto &p : plugins_) p.instance->onSeek(seconds);
+}
@@ -0,0 +1,78 @@
+#include "publisher.h"
+
+#include <chrono>
+
+#include "common/util.h"
+
+PublisherPool::PublisherPool(int num_threads, const std::vector<bool> &services, const std::vector<bool> &grouped,
+                             PublishFn publish)
+    : publish_(publish) {
+  for (int i = 0; i < num_threads; ++i) {
+    shards_.emplace_back(std::make_unique<Shard>());
+  }
+  // Deal the active services round-robin over the shards, the group takes one deal
+  shard_of_.assign(services.size(), nullptr);
+  Shard *group_shard = nullptr;
+  for (size_t which = 0, n = 0; which < services.size(); ++which) {
+    if (!services[which]) continue;
+
+    if (grouped[which] && group_shard) {
+      shard_of_[which] = group_shard;
+    } else {
+      shard_of_[which] = shards_[n++ % shards_.size()].get();
+      if (grouped[which]) group_shard = shard_of_[which];
+    }
+  }
+  for (auto &shard : shards_) {
+    shard->thread = std::thread(&PublisherPool::publishThread, this, shard.get());
+  }
+}
+
+PublisherPool::~PublisherPool() {
+  exit_ = true;
+  for (auto &shard : shards_) {
+    {
+      std::lock_guard lock(shard->mutex);
+      shard->cv.notify_one();
+    }
+    shard->thread.join();
+  }
+}
+
+void PublisherPool::push(const Event *e, uint64_t due_ts) {
+  Shard *shard = shard_of_[e->which];
+  while (!shard->queue.push({e, due_ts})) {
+    std::this_thread::yield();
+  }
+  shard->pushed.fetch_add(1, std::memory_order_relaxed);
+  if (shard->sleeping) {
+    std::lock_guard lock(shard->mutex);
+    shard->cv.notify_one();
+  }
+}
+
+void PublisherPool::drain() {
+  for (auto &shard : shards_) {
+    while (shard->published.load(std::memory_order_acquire) != shard->pushed.load(std::memory_order_relaxed)) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+void PublisherPool::publishThread(Shard *shard) {
+  util::set_thread_name("replay_publish");
+  Item item;
+  while (!exit_) {
+    if (shard->queue.pop(item)) {
+      publish_(item.event, item.due_ts);
+      shard->published.fetch_add(1, std::memory_order_release);
+      continue;
+    }
+
+    std::unique_lock lock(shard->mutex);
+    shard->sleeping = true;
+    // The timeout covers a push that raced with setting the flag
+    shard->cv.wait_for(lock, std::chrono::milliseconds(1), [&]() { return exit_ || !shard->queue.empty(); });
+    shard->sleeping = false;
+  }
+}
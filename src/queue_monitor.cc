@@ -0,0 +1,72 @@
+#include "queue_monitor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include "common/timing.h"
+#include "util.h"
+
+QueueMonitor::~QueueMonitor() {
+  if (opened_) msgq_close_queue(&q_);
+}
+
+bool QueueMonitor::open(const std::string &endpoint, size_t size) {
+  // Maps the segment already created by the PubSocket, without registering as a reader
+  opened_ = msgq_new_queue(&q_, endpoint.c_str(), size) == 0;
+  return opened_;
+}
+
+std::optional<size_t> QueueMonitor::lag(uint64_t i) const {
+  // An invalid reader was already lapped and resyncs to the writer on its next read
+  if (!*q_.read_valids[i]) return std::nullopt;
+
+  uint64_t write_cycles, write_offset, read_cycles, read_offset;
+  UNPACK64(write_cycles, write_offset, q_.write_pointer->load());
+  UNPACK64(read_cycles, read_offset, q_.read_pointers[i]->load());
+  int64_t lag = (int64_t)(write_cycles - read_cycles) * q_.size + (int64_t)write_offset - (int64_t)read_offset;
+  return std::max<int64_t>(lag, 0);
+}
+
+size_t QueueMonitor::readerLag() const {
+  if (!opened_) return 0;
+
+  size_t max_lag = 0;
+  const uint64_t num_readers = std::min<uint64_t>(*q_.num_readers, NUM_READERS);
+  for (uint64_t i = 0; i < num_readers; ++i) {
+    max_lag = std::max(max_lag, lag(i).value_or(0));
+  }
+  return max_lag;
+}
+
+int QueueMonitor::activeReaders(size_t max_lag) const {
+  if (!opened_) return 0;
+
+  int active = 0;
+  const uint64_t num_readers = std::min<uint64_t>(*q_.num_readers, NUM_READERS);
+  for (uint64_t i = 0; i < num_readers; ++i) {
+    auto reader_lag = lag(i);
+    active += reader_lag && *reader_lag <= max_lag;
+  }
+  return active;
+}
+
+void QueueMonitor::waitForReaders(size_t max_lag, int timeout_ms, const std::atomic<bool> &abort) {
+  size_t lag = readerLag();
+  if (lag <= max_lag) {
+    stalled_ = false;
+    return;
+  }
+  if (stalled_) return;
+
+  const double deadline = millis_since_boot() + timeout_ms;
+  while (lag > max_lag && !abort) {
+    if (millis_since_boot() > deadline) {
+      rWarning("%s: reader stalled, ignoring backpressure until it catches up", q_.endpoint.c_str());
+      stalled_ = true;
+      return;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(50));
+    lag = readerLag();
+  }
+}
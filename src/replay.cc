@@ -1,30 +1,81 @@
 #include "replay.h"
 
 #include <capnp/dynamic.h>
-#include <csignal>
+#include <limits>
 #include "cereal/services.h"
 #include "common/params.h"
 #include "util.h"
 
-static void interrupt_sleep_handler(int signal) {}
-
 // Helper function to notify events with safety checks
 template <typename Callback, typename... Args>
 void notifyEvent(Callback &callback, Args &&...args) {
   if (callback) callback(std::forward<Args>(args)...);
 }
 
-Replay::Replay(const ReplayConfig& cfg)
-    : flags_(cfg.flags), speed_(cfg.playback_speed), msg_ctx_(Context::create()) {
-  std::signal(SIGUSR1, interrupt_sleep_handler);
+// Keep the events of the published services, plus those needed to start the stream
+static std::vector<bool> segmentFilters(const ReplayConfig &cfg) {
+  if (cfg.allow.empty() && cfg.block.empty()) return {};
+
+  auto event_schema = capnp::Schema::from<cereal::Event>().asStruct();
+  std::vector<bool> filters(event_schema.getUnionFields().size(), false);
+  filters[cereal::Event::Which::INIT_DATA] = true;
+  filters[cereal::Event::Which::CAR_PARAMS] = true;
+  for (const auto &[name, _] : services) {
+    if ((cfg.allow.empty() || cfg.allow.count(name)) && !cfg.block.count(name)) {
+      filters[event_schema.getFieldByName(name).getProto().getDiscriminantValue()] = true;
+    }
+  }
+  return filters;
+}
+
+// Without a --rate-limit, the encode indices are kept whole since their frames are never
+// decimated, and so are services of 1 Hz or less, which are sparse or carry events
+static bool decimatedByDefault(const std::string &name, const service &serv) {
+  return serv.frequency > 1.0 && name.find("EncodeIdx") == std::string::npos;
+}
 
+Replay::Replay(const ReplayConfig& cfg, std::unique_ptr<SegmentManager> preloaded)
+    : flags_(cfg.flags), speed_(cfg.playback_speed), publish_batch_ns_(std::max(0, cfg.publish_batch_us) * 1000ull),
+      msg_ctx_(Context::create()) {
   setupServices(cfg);
-  setupSegmentManager(cfg);
+  setupSegmentManager(cfg, std::move(preloaded));
+  plugin_specs_ = cfg.plugins;
+  camera_options_.decode_ahead = cfg.decode_ahead;
+  camera_options_.queue_size = cfg.frame_queue;
+  camera_options_.policy = cfg.frame_policy;
+  camera_options_.fanout_prefixes = cfg.fanout_prefixes;
+  if (!(cfg.flags & (REPLAY_FLAG_NO_FRAME_SKIP | REPLAY_FLAG_MAX_THROUGHPUT | REPLAY_FLAG_LOCKSTEP))) {
+    camera_options_.speed = &speed_;
+  }
+}
+
+std::unique_ptr<SegmentManager> Replay::preloadRoute(const ReplayConfig &cfg) {
+  auto seg_mgr = std::make_unique<SegmentManager>(cfg);
+  seg_mgr->setFilters(segmentFilters(cfg));
+  if (!seg_mgr->load()) return nullptr;
+
+  // The segment start() will seek to
+  seg_mgr->setCurrentSegment(seg_mgr->route_.segments().begin()->first + cfg.start_seconds / 60);
+  return seg_mgr;
 }
 
 void Replay::setupServices(const ReplayConfig& cfg) {
   auto event_schema = capnp::Schema::from<cereal::Event>().asStruct();
   sockets_.assign(event_schema.getUnionFields().size(), nullptr);
+  socket_failed_.assign(sockets_.size(), false);
+  service_info_.assign(sockets_.size(), nullptr);
+  queue_monitors_.resize(sockets_.size());
+  min_publish_interval_.assign(sockets_.size(), 0);
+  last_published_mono_.assign(sockets_.size(), 0);
+  const bool decimation = !cfg.no_decimate.count("all");
+
+  fanout_prefixes_ = cfg.fanout_prefixes;
+  fanout_sockets_.assign(fanout_prefixes_.size(), std::vector<PubSocket *>(sockets_.size(), nullptr));
+
+  backpressure_ = (cfg.flags & REPLAY_FLAG_MAX_THROUGHPUT) && !messaging_use_zmq();
+  if ((cfg.flags & REPLAY_FLAG_MAX_THROUGHPUT) && !backpressure_) {
+    rWarning("max throughput: reader backpressure requires msgq, publishing unthrottled");
+  }
 
   std::vector<const char *> active_services;
   active_services.reserve(services.size());
@@ -32,25 +83,46 @@ void Replay::setupServices(const ReplayConfig& cfg) {
   for (const auto &[name, serv] : services) {
    if ((cfg.allow.empty() || cfg.allow.count(name)) && !cfg.block.count(name)) {
       uint16_t which = event_schema.getFieldByName(name).getProto().getDiscriminantValue();
-      sockets_[which] = PubSocket::create(msg_ctx_, name, true, serv.queue_size);
+      service_info_[which] = &serv;  // The socket is created once a merged segment contains it
+      publish_stats_.addService(which, name, serv.frequency);
+      auto limit = cfg.rate_limits.find(name);
+      const bool has_limit = limit != cfg.rate_limits.end();
+      float max_hz = has_limit ? limit->second : serv.frequency;
+      if (decimation && max_hz > 0 && !cfg.no_decimate.count(name) && (has_limit || decimatedByDefault(name, serv))) {
+        // 10% slack, so that jitter in the logged timestamps is not decimated at 1x
+        min_publish_interval_[which] = 0.9e9 / max_hz;
+      }
       active_services.push_back(name.c_str());
     }
   }
 
   std::string services_str = join(active_services, ", ");
   rInfo("active services: %s", services_str.c_str());
-}
 
-void Replay::setupSegmentManager(const ReplayConfig &cfg) {
-  seg_mgr_ = std::make_unique<SegmentManager>(cfg);
-  seg_mgr_->setCallback([this]() { handleSegmentMerge(); });
+  if (!cfg.event_ring.empty()) {
+    event_ring_ = std::make_unique<EventRingWriter>(cfg.event_ring, cfg.event_ring_size);
+  }
 
-  if (!cfg.allow.empty() || !cfg.block.empty()) {
-    std::vector<bool> filters(sockets_.size(), false);
-    for (size_t i = 0; i < sockets_.size(); ++i) {
-      filters[i] = (i == cereal::Event::Which::INIT_DATA || i == cereal::Event::Which::CAR_PARAMS || sockets_[i]);
+  if (cfg.publisher_threads > 0) {
+    std::vector<bool> active(sockets_.size()), frames(sockets_.size());
+    for (size_t i = 0; i < sockets_.size(); ++i) active[i] = service_info_[i] != nullptr;
+    // CameraServer::pushFrame is called from one thread only
+    for (auto which : {cereal::Event::ROAD_ENCODE_IDX, cereal::Event::DRIVER_ENCODE_IDX, cereal::Event::WIDE_ROAD_ENCODE_IDX}) {
+      frames[which] = true;
     }
-    seg_mgr_->setFilters(filters);
+    publishers_ = std::make_unique<PublisherPool>(cfg.publisher_threads, active, frames,
+                                                  [this](const Event *e, uint64_t due_ts) { publishEvent(e, due_ts); });
+  }
+}
+
+void Replay::setupSegmentManager(const ReplayConfig &cfg, std::unique_ptr<SegmentManager> preloaded) {
+  preloaded_ = preloaded != nullptr;
+  if (preloaded_) {
+    seg_mgr_ = std::move(preloaded);
+  } else {
+    seg_mgr_ = std::make_unique<SegmentManager>(cfg);
+    seg_mgr_->setFilters(segmentFilters(cfg));
+    seg_mgr_->setCallback([this]() { handleSegmentMerge(); });
   }
 }
 
@@ -61,17 +133,32 @@ Replay::~Replay() {
       exit_ = true;
       return false;
     });
+    completeStep(true);  // Release callers blocked in a step
     stream_thread_.join();
+    publishers_.reset();
     rInfo("shutdown: done");
   }
+  if (seek_stats_.ready.count() > 0) {
+    rInfo("seek latency:\n%s", seek_stats_.summary().c_str());
+  }
+  if (publish_stats_.resyncs() > 0 || !publish_stats_.snapshot().empty()) {
+    rInfo("publish timing:\n%s", publish_stats_.summary().c_str());
+  }
   camera_server_.reset();
   seg_mgr_.reset();
+  queue_monitors_.clear();
   delete msg_ctx_;
 }
 
 bool Replay::load() {
-  rInfo("loading route %s", seg_mgr_->route_.name().c_str());
-  if (!seg_mgr_->load()) return false;
+  for (const auto &spec : plugin_specs_) {
+    if (!plugins_.load(spec)) return false;
+  }
+
+  if (!preloaded_) {
+    rInfo("loading route %s", seg_mgr_->route_.name().c_str());
+    if (!seg_mgr_->load()) return false;
+  }
 
   min_seconds_ = seg_mgr_->route_.segments().begin()->first * 60;
   max_seconds_ = (seg_mgr_->route_.segments().rbegin()->first + 1) * 60;
@@ -79,11 +166,14 @@ bool Replay::load() {
 }
 
 void Replay::interruptStream(const std::function<bool()> &update_fn) {
-  if (stream_thread_.joinable() && stream_thread_id) {
-    pthread_kill(stream_thread_id, SIGUSR1);  // Interrupt sleep in stream thread
-  }
   {
     interrupt_requested_ = true;
+    stream_timer_.wake();  // Interrupt sleep in stream thread
+    {
+      // Wake the stream if it is waiting for the next step
+      std::lock_guard step_lock(step_mutex_);
+      step_cv_.notify_all();
+    }
     std::unique_lock lock(stream_lock_);
     events_ready_ = update_fn();
     interrupt_requested_ = user_paused_;
@@ -91,7 +181,20 @@ void Replay::interruptStream(const std::function<bool()> &update_fn) {
   stream_cv_.notify_one();
 }
 
+void Replay::start(int seconds) {
+  if (preloaded_) {
+    // The preloaded manager keeps merging while this Replay is set up, only report merges from now on
+    seg_mgr_->setCallback([this]() { handleSegmentMerge(); });
+  }
+  seekTo(min_seconds_ + seconds, false);
+  if (preloaded_) {
+    // Segments merged while preloading were never reported
+    handleSegmentMerge();
+  }
+}
+
 void Replay::seekTo(double seconds, bool relative) {
+  const uint64_t start_ts = nanos_since_boot();
   double target_time = relative ? seconds + currentSeconds() : seconds;
   target_time = std::max(0.0, target_time);
   int target_segment = target_time / 60;
@@ -102,6 +205,7 @@ void Replay::seekTo(double seconds, bool relative) {
 
   rInfo("Seeking to %d s, segment %d", (int)target_time, target_segment);
   notifyEvent(onSeeking, target_time);
+  plugins_.onSeek(target_time);
 
   interruptStream([&]() {
     current_segment_.store(target_segment);
@@ -111,14 +215,53 @@ void Replay::seekTo(double seconds, bool relative) {
     return false;
   });
 
+  {
+    std::lock_guard lock(step_mutex_);
+    stream_at_end_ = false;
+  }
+
+  {
+    std::lock_guard lock(seek_mutex_);
+    awaiting_first_frame_ = false;
+    if (seek_open_) {
+      finishSeek();  // The previous seek never got a frame
+    }
+    seek_open_ = true;
+    seek_start_ts_ = start_ts;
+    seek_timings_ = {};
+    seek_timings_.target_seconds = target_time;
+    seek_timings_.segment = target_segment;
+    seek_timings_.lookup = (nanos_since_boot() - start_ts) / 1e6;
+  }
+
   seg_mgr_->setCurrentSegment(target_segment);
   checkSeekProgress();
 }
 
 void Replay::checkSeekProgress() {
-  if (!seg_mgr_->getEventData()->isSegmentLoaded(current_segment_.load())) return;
+  auto event_data = seg_mgr_->getEventData();
+  auto seg_it = event_data->segments.find(current_segment_.load());
+  if (seg_it == event_data->segments.end()) return;
 
   double seek_to = seeking_to_.exchange(-1.0, std::memory_order_acquire);
+  if (seek_to >= 0) {
+    std::lock_guard lock(seek_mutex_);
+    const uint64_t now = nanos_since_boot();
+    seek_timings_.ready = (now - seek_start_ts_) / 1e6;
+    // Phases that ran before the seek started belong to an earlier prefetch
+    const auto &log_timings = seg_it->second->log->timings;
+    if (log_timings.finished_ts >= seek_start_ts_) {
+      seek_timings_.log = log_timings;
+    }
+    if (event_data->merged_ts >= seek_start_ts_) {
+      seek_timings_.merge = event_data->merge_ms;
+    }
+    if (camera_server_) {
+      awaiting_first_frame_ = true;
+    } else {
+      finishSeek();
+    }
+  }
   if (seek_to >= 0 && onSeekedTo) {
     onSeekedTo(seek_to);
   }
@@ -127,6 +270,23 @@ void Replay::checkSeekProgress() {
   interruptStream([]() { return true; });
 }
 
+// Called with seek_mutex_ held
+void Replay::finishSeek() {
+  const auto &t = seek_timings_;
+  rDebug("seek to %.1f s (segment %d): ready %.1f ms [lookup %.1f, queue %.1f, read %.1f, decompress %.1f, "
+         "parse %.1f, sort %.1f, merge %.1f], first frame %.1f ms",
+         t.target_seconds, t.segment, t.ready, t.lookup, t.log.queue, t.log.read, t.log.decompress,
+         t.log.parse, t.log.sort, t.merge, t.first_frame);
+  seek_stats_.record(t);
+  last_seek_timings_ = t;
+  seek_open_ = false;
+}
+
+SeekTimings Replay::lastSeekTimings() {
+  std::lock_guard lock(seek_mutex_);
+  return last_seek_timings_;
+}
+
 void Replay::seekToFlag(FindFlag flag) {
   if (auto next = timeline_.find(currentSeconds(), flag)) {
     seekTo(*next - 2, false);  // seek to 2 seconds before next
@@ -144,6 +304,7 @@ void Replay::pause(bool pause) {
 }
 
 void Replay::handleSegmentMerge() {
+  std::lock_guard lock(merge_mutex_);
   if (exit_) return;
 
   auto event_data = seg_mgr_->getEventData();
@@ -153,10 +314,35 @@ void Replay::handleSegmentMerge() {
   notifyEvent(onSegmentsMerged);
 
   // Interrupt the stream to handle segment merge
-  interruptStream([]() { return false; });
+  interruptStream([&]() {
+    if (!hasFlag(REPLAY_FLAG_NO_MSGQ)) createSockets(*event_data);
+    return false;
+  });
   checkSeekProgress();
 }
 
+// Called while the stream is interrupted, no publisher is sending. Creating a publisher resets
+// the queue, so it is done before the first message instead of on the paced send path.
+void Replay::createSockets(const SegmentManager::EventData &event_data) {
+  for (const auto &[n, segment] : event_data.segments) {
+    if (!socket_segments_.insert(n).second) continue;
+    for (const auto &e : segment->log->events) {
+      if (service_info_[e.which] && !sockets_[e.which] && !socket_failed_[e.which]) {
+        createSocket(e.which);
+      }
+    }
+  }
+}
+
+void Replay::createSocket(int which) {
+  const service *serv = service_info_[which];
+  sockets_[which] = PubSocket::create(msg_ctx_, serv->name, true, serv->queue_size);
+  for (size_t i = 0; i < fanout_prefixes_.size(); ++i) {
+    fanout_sockets_[i][which] =
+        PubSocket::create(msg_ctx_, fanoutEndpoint(fanout_prefixes_[i], serv->name), false, serv->queue_size);
+  }
+}
+
 void Replay::startStream(const std::shared_ptr<Segment> segment) {
   const auto &events = segment->log->events;
   route_start_ts_ = events.front().mono_time;
@@ -189,6 +375,11 @@ void Replay::startStream(const std::shared_ptr<Segment> segment) {
     Params params;
     params.put("CarParams", (const char *)bytes.begin(), bytes.size());
     params.put("CarParamsPersistent", (const char *)bytes.begin(), bytes.size());
+    const std::string value((const char *)bytes.begin(), bytes.size());
+    for (const auto &prefix : fanout_prefixes_) {
+      putFanoutParam(prefix, "CarParams", value);
+      putFanoutParam(prefix, "CarParamsPersistent", value);
+    }
   } else {
     rWarning("failed to read CarParams from current segment");
   }
@@ -197,11 +388,16 @@ void Replay::startStream(const std::shared_ptr<Segment> segment) {
   if (!hasFlag(REPLAY_FLAG_NO_VIPC)) {
     std::pair<int, int> camera_size[MAX_CAMERAS] = {};
     for (auto type : ALL_CAMERAS) {
-      if (auto &fr = segment->frames[type]) {
+      if (auto fr = segment->frameReader(type)) {
         camera_size[type] = {fr->width, fr->height};
       }
     }
-    camera_server_ = std::make_unique<CameraServer>(camera_size);
+    camera_server_ = std::make_unique<CameraServer>(camera_size, camera_options_);
+    if (!plugins_.empty()) {
+      camera_server_->setFrameCallback([this](CameraType type, const VisionBuf *buf, const Event *e) {
+        plugins_.onFrame(type, buf, e);
+      });
+    }
   }
 
   timeline_.initialize(seg_mgr_->route_, route_start_ts_, !(flags_ & REPLAY_FLAG_NO_FILE_CACHE),
@@ -210,19 +406,76 @@ void Replay::startStream(const std::shared_ptr<Segment> segment) {
   stream_thread_ = std::thread(&Replay::streamThread, this);
 }
 
-void Replay::publishMessage(const Event *e) {
-  if (event_filter_ && event_filter_(e)) return;
+// Called from the stream thread, which is the only writer of the event ring and
+// delivers events to the plugins in publish order. due_ts is the wall time the event
+// is due at on the stream's schedule, 0 if it is not paced.
+void Replay::dispatchEvent(const Event *e, uint64_t due_ts) {
+  if (e->eidx_segnum == -1) {
+    // The filter runs once per message, here, and its answer holds for every output
+    if (event_filter_ && event_filter_(e)) return;
+
+    if (event_ring_) event_ring_->write(*e);
+    if (!plugins_.empty()) plugins_.onEvent(e);
+    if (hasFlag(REPLAY_FLAG_NO_MSGQ)) {
+      recordLateness(e, due_ts);
+      return;
+    }
+  }
+
+  if (publishers_) {
+    publishers_->push(e, due_ts);
+  } else {
+    publishEvent(e, due_ts);
+  }
+}
 
+void Replay::publishEvent(const Event *e, uint64_t due_ts) {
+  if (e->eidx_segnum == -1) {
+    publishMessage(e, due_ts);
+  } else if (camera_server_) {
+    publishFrame(e, due_ts);
+  }
+}
+
+// How late the event went out against the stream's schedule. Taken after each send, so
+// queueing behind a batch or a publisher shard and slow sends count.
+void Replay::recordLateness(const Event *e, uint64_t due_ts) {
+  if (due_ts > 0) {
+    publish_stats_.record(e->which, std::max<int64_t>(0, (int64_t)(nanos_monotonic() - due_ts)) / 1e6);
+  }
+}
+
+void Replay::publishMessage(const Event *e, uint64_t due_ts) {
   auto bytes = e->data.asBytes();
-  int ret = sockets_[e->which]->send((char*)bytes.begin(), bytes.size());
+  // Only the thread publishing this service touches its socket
+  PubSocket *&sock = sockets_[e->which];
+  if (!sock) {
+    if (socket_failed_[e->which]) return;
+    // The stream got to the segment before its merge was handled
+    createSocket(e->which);
+  }
+
+  int ret = sock->send((char*)bytes.begin(), bytes.size());
+  recordLateness(e, due_ts);
   if (ret == -1) {
-    rWarning("stop publishing %s due to multiple publishers error", sockets_[e->which]);
-    delete sockets_[e->which];
-    sockets_[e->which] = nullptr;
+    rWarning("stop publishing %s due to multiple publishers error", service_info_[e->which]->name.c_str());
+    delete sock;
+    sock = nullptr;
+    socket_failed_[e->which] = true;
+  }
+
+  for (size_t i = 0; i < fanout_prefixes_.size(); ++i) {
+    PubSocket *&fanout_sock = fanout_sockets_[i][e->which];
+    if (fanout_sock && fanout_sock->send((char *)bytes.begin(), bytes.size()) == -1) {
+      rWarning("stop publishing %s to %s due to multiple publishers error", service_info_[e->which]->name.c_str(),
+               fanout_prefixes_[i].c_str());
+      delete fanout_sock;
+      fanout_sock = nullptr;
+    }
   }
 }
 
-void Replay::publishFrame(const Event* e) {
+void Replay::publishFrame(const Event* e, uint64_t due_ts) {
   CameraType cam;
   if (e->which == cereal::Event::ROAD_ENCODE_IDX)
     cam = RoadCam;
@@ -235,14 +488,40 @@ void Replay::publishFrame(const Event* e) {
 
   auto seg_it = event_data_->segments.find(e->eidx_segnum);
   if (seg_it != event_data_->segments.end()) {
-    if (auto &frame = seg_it->second->frames[cam]; frame) {
-      camera_server_->pushFrame(cam, frame.get(), e);
+    if (auto frame = seg_it->second->frameReader(cam)) {
+      if (video_gap_segment_[cam] == e->eidx_segnum) {
+        rDebug("camera[%d] video of segment %d is ready, resume sending frames", cam, e->eidx_segnum);
+        video_gap_segment_[cam] = -1;
+      }
+      // The camera thread times the first frame after a seek, the stream does not wait for it
+      std::function<void()> on_sent;
+      if (awaiting_first_frame_.exchange(false)) {
+        uint64_t seek = 0;
+        {
+          std::lock_guard lock(seek_mutex_);
+          seek = seek_start_ts_;
+        }
+        on_sent = [this, seek]() {
+          std::lock_guard lock(seek_mutex_);
+          if (!seek_open_ || seek_start_ts_ != seek) return;  // A later seek started already
+          seek_timings_.first_frame = (nanos_since_boot() - seek) / 1e6;
+          finishSeek();
+        };
+      }
+      camera_server_->pushFrame(cam, frame, e, std::move(on_sent));
+      recordLateness(e, due_ts);
+      if (hasFlag(REPLAY_FLAG_MAX_THROUGHPUT) || hasFlag(REPLAY_FLAG_LOCKSTEP)) {
+        camera_server_->waitForSent();  // Frames are never dropped, the stream waits for the decoder
+      }
+    } else if (video_gap_segment_[cam] != e->eidx_segnum) {
+      // Logs are published before the video finishes loading, skip frames until it is ready
+      rDebug("camera[%d] video of segment %d is not ready, skipping frames", cam, e->eidx_segnum);
+      video_gap_segment_[cam] = e->eidx_segnum;
     }
   }
 }
 
 void Replay::streamThread() {
-  stream_thread_id = pthread_self();
   std::unique_lock lk(stream_lock_);
 
   while (true) {
@@ -250,44 +529,141 @@ void Replay::streamThread() {
     if (exit_) break;
 
     event_data_ = seg_mgr_->getEventData();
-    const auto &events = event_data_->events;
-    auto first = std::upper_bound(events.cbegin(), events.cend(), Event(cur_which_, cur_mono_time_, {}));
-    if (first == events.cend()) {
+    auto first = event_data_->events.upperBound(Event(cur_which_, cur_mono_time_, {}));
+    if (first.atEnd()) {
       rInfo("waiting for events...");
       events_ready_ = false;
+      if (hasFlag(REPLAY_FLAG_LOCKSTEP) && reachedRouteEnd()) completeStep(true);
       continue;
     }
 
-    auto it = publishEvents(first, events.cend());
+    auto it = publishEvents(first);
 
-    // Ensure frames are sent before unlocking to prevent race conditions
+    // Ensure events and frames are sent before unlocking to prevent race conditions
+    if (publishers_) {
+      publishers_->drain();
+    }
     if (camera_server_) {
-      camera_server_->waitForSent();
+      // After an interrupt the stream continues elsewhere, the queued frames are stale
+      if (interrupt_requested_) {
+        camera_server_->discardQueued();
+      } else {
+        camera_server_->waitForSent();
+      }
     }
 
-    if (it == events.cend() && !hasFlag(REPLAY_FLAG_NO_LOOP)) {
-      int last_segment = seg_mgr_->route_.segments().rbegin()->first;
-      if (event_data_->isSegmentLoaded(last_segment)) {
+    if (it.atEnd() && hasFlag(REPLAY_FLAG_LOCKSTEP)) {
+      // Lockstep never loops, the driver decides where to go next
+      if (reachedRouteEnd()) completeStep(true);
+    } else if (it.atEnd() && !hasFlag(REPLAY_FLAG_NO_LOOP)) {
+      if (reachedRouteEnd()) {
         rInfo("reaches the end of route, restart from beginning");
         stream_lock_.unlock();
         seekTo(minSeconds(), false);
         stream_lock_.lock();
       }
+    } else if (it.atEnd() && reachedRouteEnd()) {
+      notifyEvent(onRouteEnd);
+    }
+  }
+}
+
+// Cap the wall-clock publish rate of each service above 1x: at speed s, a message is dropped
+// if the previous one of its service was published less than s * interval of log time before.
+bool Replay::decimate(const Event &evt, double speed) {
+  const uint64_t interval = min_publish_interval_[evt.which];
+  if (interval == 0 || evt.eidx_segnum != -1) return false;
+
+  uint64_t &last = last_published_mono_[evt.which];
+  if (speed > 1.0 && evt.mono_time >= last && evt.mono_time - last < interval * speed) {
+    publish_stats_.recordDecimated(evt.which);
+    return true;
+  }
+  last = evt.mono_time;
+  return false;
+}
+
+QueueMonitor *Replay::queueMonitor(int which) {
+  if (!backpressure_) return nullptr;
+
+  auto &monitor = queue_monitors_[which];
+  if (!monitor) {
+    monitor = std::make_unique<QueueMonitor>();
+    if (!monitor->open(service_info_[which]->name, service_info_[which]->queue_size)) {
+      rWarning("failed to monitor queue %s, publishing without backpressure", service_info_[which]->name.c_str());
     }
   }
+  return monitor.get();
+}
+
+bool Replay::reachedRouteEnd() const {
+  return event_data_->isSegmentLoaded(seg_mgr_->route_.segments().rbegin()->first);
+}
+
+size_t Replay::stepTo(uint64_t mono_time) {
+  return step(mono_time, std::numeric_limits<size_t>::max());
+}
+
+size_t Replay::stepEvents(size_t n) {
+  return step(std::numeric_limits<uint64_t>::max(), n);
+}
+
+size_t Replay::step(uint64_t until, size_t n) {
+  std::unique_lock lock(step_mutex_);
+  if (stream_at_end_ || exit_) return 0;
+
+  step_until_ = until;
+  step_events_ = n;
+  step_published_ = 0;
+  step_pending_ = true;
+  step_cv_.notify_all();
+  step_cv_.wait(lock, [this]() { return !step_pending_ || exit_; });
+  return step_published_;
+}
+
+void Replay::completeStep(bool at_end) {
+  std::lock_guard lock(step_mutex_);
+  stream_at_end_ = stream_at_end_ || at_end;
+  if (step_pending_) {
+    step_pending_ = false;
+    step_cv_.notify_all();
+  }
 }
 
-std::vector<Event>::const_iterator Replay::publishEvents(std::vector<Event>::const_iterator first,
-                                                         std::vector<Event>::const_iterator last) {
-  uint64_t evt_start_ts = first->mono_time;
-  uint64_t loop_start_ts = nanos_since_boot();
+// Block the stream until the current step covers the event. Events without a socket
+// are bound by the step time but do not count towards a step of n events.
+bool Replay::waitForStep(const Event &evt, bool counted) {
+  std::unique_lock lock(step_mutex_);
+  while (!step_pending_ || evt.mono_time > step_until_ || (counted && step_events_ == 0)) {
+    if (step_pending_) {
+      if (publishers_) publishers_->drain();
+      step_pending_ = false;  // The step is complete
+      step_cv_.notify_all();
+    }
+    step_cv_.wait(lock, [this]() { return step_pending_ || interrupt_requested_; });
+    if (interrupt_requested_) return false;
+  }
+  if (counted) {
+    --step_events_;
+    ++step_published_;
+  }
+  return true;
+}
+
+EventIndex::Cursor Replay::publishEvents(EventIndex::Cursor it) {
+  uint64_t evt_start_ts = it->mono_time;
+  uint64_t loop_start_ts = nanos_monotonic();
   uint64_t next_segment_check = 0;
+  uint64_t batch_end = 0;
+  uint64_t batch_wake_ts = 0;
   double prev_replay_speed = speed_;
+  const bool max_throughput = hasFlag(REPLAY_FLAG_MAX_THROUGHPUT);
+  const bool lockstep = hasFlag(REPLAY_FLAG_LOCKSTEP);
 
-  for (; first != last; ++first) {
+  for (; !it.atEnd(); ++it) {
     if (interrupt_requested_.load(std::memory_order_relaxed)) break;
 
-    const Event &evt = *first;
+    const Event &evt = *it;
 
     // Only check segment every ~1 second of log time
     if (evt.mono_time > next_segment_check) {
@@ -299,34 +675,70 @@ std::vector<Event>::const_iterator Replay::publishEvents(std::vector<Event>::con
       next_segment_check = evt.mono_time + 1e9;
     }
 
+    if (lockstep && !waitForStep(evt, service_info_[evt.which] != nullptr)) break;
+
     cur_mono_time_ = evt.mono_time;
     cur_which_ = evt.which;
 
-    // Skip events if socket is not present
-    if (!sockets_[evt.which]) continue;
-
-    const uint64_t current_nanos = nanos_since_boot();
-    const int64_t time_diff = (evt.mono_time - evt_start_ts) / speed_ - (current_nanos - loop_start_ts);
-
-    // Reset timestamps for potential synchronization issues:
-    // - A negative time_diff may indicate slow execution or system wake-up,
-    // - A time_diff exceeding 1 second suggests a skipped segment.
-    if ((time_diff < -1e9 || time_diff >= 1e9) || speed_ != prev_replay_speed) {
-      evt_start_ts = evt.mono_time;
-      loop_start_ts = current_nanos;
-      prev_replay_speed = speed_;
-    } else if (time_diff > 0) {
-      precise_nano_sleep(time_diff, interrupt_requested_);
+    // Skip events of services that are not published
+    if (!service_info_[evt.which]) continue;
+
+    if (max_throughput || lockstep) {
+      // No wall-clock pacing. Monitored queues are drained to at least half by their readers
+      if (auto monitor = queueMonitor(evt.which)) {
+        monitor->waitForReaders(monitor->size() / 2, 1000, interrupt_requested_);
+        if (interrupt_requested_) break;
+      }
+      dispatchEvent(&evt);
+      continue;
     }
 
-    if (interrupt_requested_) break;
+    if (decimate(evt, speed_)) continue;
+
+    // Sleep once for the first event of a batch, the events due within the
+    // batch window after it are published back-to-back.
+    if (evt.mono_time > batch_end) {
+      const uint64_t current_nanos = nanos_monotonic();
+      const int64_t time_diff = (evt.mono_time - evt_start_ts) / speed_ - (current_nanos - loop_start_ts);
+
+      // Reset timestamps for potential synchronization issues:
+      // - A negative time_diff may indicate slow execution or system wake-up,
+      // - A time_diff exceeding 1 second suggests a skipped segment.
+      if ((time_diff < -1e9 || time_diff >= 1e9) || speed_ != prev_replay_speed) {
+        if (speed_ == prev_replay_speed) publish_stats_.recordResync();
+        evt_start_ts = evt.mono_time;
+        loop_start_ts = current_nanos;
+        prev_replay_speed = speed_;
+        batch_wake_ts = 0;
+      } else if (time_diff > 0) {
+        // A wake up before the deadline delivers an interrupt or a speed change
+        uint64_t deadline = current_nanos + time_diff;
+        while (!stream_timer_.sleepUntil(deadline) && !interrupt_requested_) {
+          if (speed_ == prev_replay_speed) continue;
+
+          // Keep the log time reached so far and reschedule the rest at the new speed
+          const uint64_t now = nanos_monotonic();
+          evt_start_ts += (now - loop_start_ts) * prev_replay_speed;
+          loop_start_ts = now;
+          prev_replay_speed = speed_;
+          batch_wake_ts = 0;
+          deadline = now + std::max<int64_t>(0, (int64_t)(evt.mono_time - evt_start_ts)) / prev_replay_speed;
+        }
+      }
 
-    if (evt.eidx_segnum == -1) {
-      publishMessage(&evt);
-    } else if (camera_server_) {
-      publishFrame(&evt);
+      if (interrupt_requested_) break;
+
+      const uint64_t wake_ts = nanos_monotonic();
+      if (batch_wake_ts > 0) {
+        publish_stats_.addPlaybackTime((wake_ts - batch_wake_ts) * prev_replay_speed);
+      }
+      batch_wake_ts = wake_ts;
+      batch_end = evt.mono_time + publish_batch_ns_ * prev_replay_speed;
     }
+
+    // Events sent early within a batch count as on time
+    dispatchEvent(&evt, loop_start_ts + (evt.mono_time - evt_start_ts) / prev_replay_speed);
   }
 
-  return first;
+  return it;
 }
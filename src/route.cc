@@ -4,8 +4,10 @@
 #include <filesystem>
 #include <regex>
 
+#include "common/timing.h"
 #include "hardware.h"
 #include "api.h"
+#include "auto_source.h"
 #include "replay.h"
 #include "util.h"
 
@@ -80,24 +82,8 @@ bool Route::loadSegments() {
 }
 
 bool Route::loadFromAutoSource() {
-  auto origin_prefix = getenv("OPENPILOT_PREFIX");
-  if (origin_prefix) {
-    setenv("OPENPILOT_PREFIX", "", 1);
-  }
-  auto cmd = util::string_format("../auto_source.py \"%s\"", route_string_.c_str());
-  auto log_files = split(util::check_output(cmd), '\n');
-  if (origin_prefix) {
-    setenv("OPENPILOT_PREFIX", origin_prefix, 1);
-  }
-
-  const static std::regex rx(R"(\/(\d+)\/)");
-  for (int i = 0; i < log_files.size(); ++i) {
-    int seg_num = i;
-    std::smatch match;
-    if (std::regex_search(log_files[i], match, rx)) {
-      seg_num = std::stoi(match[1]);
-    }
-    addFileToSegment(seg_num, log_files[i]);
+  for (const auto &[seg_num, file] : resolveAutoSource(route_, data_dir_)) {
+    addFileToSegment(seg_num, file);
   }
   return !segments_.empty();
 }
@@ -193,8 +179,10 @@ void Route::addFileToSegment(int n, const std::string &file) {
 // class Segment
 
 Segment::Segment(int n, const SegmentFile &files, uint32_t flags, const std::vector<bool> &filters,
-                 std::function<void(int, bool)> callback)
-    : seg_num(n), flags(flags), filters_(filters), on_load_finished_(callback) {
+                 std::function<void(int, bool)> callback, TaskPriority priority,
+                 std::shared_ptr<const CompressedLog> cached_log)
+    : seg_num(n), flags(flags), filters_(filters), on_load_finished_(callback), cached_log_(cached_log),
+      created_ts_(millis_since_boot()) {
   // [RoadCam, DriverCam, WideRoadCam, log]. fallback to qcamera/qlog
   const std::array file_list = {
       (flags & REPLAY_FLAG_QCAMERA) || files.road_cam.empty() ? files.qcamera : files.road_cam,
@@ -202,10 +190,11 @@ Segment::Segment(int n, const SegmentFile &files, uint32_t flags, const std::vec
       flags & REPLAY_FLAG_ECAM ? files.wide_road_cam : "",
       files.rlog.empty() ? files.qlog : files.rlog,
   };
+  // Logs are needed first, videos are loaded one priority level lower
+  const auto video_priority = (TaskPriority)std::min((int)priority + 1, (int)TaskPriority::Low);
   for (int i = 0; i < file_list.size(); ++i) {
     if (!file_list[i].empty() && (!(flags & REPLAY_FLAG_NO_VIPC) || i >= MAX_CAMERAS)) {
-      ++loading_;
-      threads_.emplace_back(&Segment::loadFile, this, i, file_list[i]);
+      tasks_.submit([this, i, file = file_list[i]]() { loadFile(i, file); }, i < MAX_CAMERAS ? video_priority : priority);
     }
   }
 }
@@ -215,35 +204,61 @@ Segment::~Segment() {
     std::lock_guard lock(mutex_);
     on_load_finished_ = nullptr;  // Prevent callback after destruction
   }
-  abort_ = true;
-  for (auto &thread : threads_) {
-    if (thread.joinable()) thread.join();
-  }
+  tasks_.cancel();
+  tasks_.wait();
 }
 
 void Segment::loadFile(int id, const std::string file) {
   const bool local_cache = !(flags & REPLAY_FLAG_NO_FILE_CACHE);
+  std::atomic<bool> *abort = tasks_.cancelFlag();
   bool success = false;
   if (id < MAX_CAMERAS) {
-    frames[id] = std::make_unique<FrameReader>();
-    success = frames[id]->load((CameraType)id, file, flags & REPLAY_FLAG_NO_HW_DECODER, &abort_, local_cache);
+    auto fr = std::make_shared<FrameReader>();
+    success = fr->load((CameraType)id, file, flags & REPLAY_FLAG_NO_HW_DECODER, abort, local_cache);
+    if (success) {
+      frames_[id] = std::move(fr);
+      frame_ready_[id] = true;
+    } else if (!*abort) {
+      rWarning("failed to load video of segment %d, camera %d", seg_num, id);
+    }
   } else {
-    log = std::make_unique<LogReader>(filters_);
-    success = log->load(file, flags & REPLAY_FLAG_LOW_MEMORY, &abort_, local_cache);
+    const double queue_time = millis_since_boot() - created_ts_;
+    if (cached_log_) {
+      log = std::make_unique<LogReader>(filters_);
+      success = log->load(*cached_log_, abort);
+      cached_log_.reset();
+    }
+    if (!success && !*abort) {
+      log = std::make_unique<LogReader>(filters_);
+      success = log->load(file, flags & REPLAY_FLAG_LOW_MEMORY, abort, local_cache);
+    }
+    log->timings.queue = queue_time;
+    if (!success) {
+      // videos are useless without the log, abort all loading jobs.
+      tasks_.cancel();
+    }
   }
 
-  if (!success) {
-    // abort all loading jobs.
-    abort_ = true;
+  std::lock_guard lock(mutex_);
+  if (id == MAX_CAMERAS) {
+    load_state_ = success ? LoadState::Loaded : LoadState::Failed;
+  }
+  if (on_load_finished_) {
+    on_load_finished_(seg_num, success);
   }
+}
 
-  if (--loading_ == 0) {
-    std::lock_guard lock(mutex_);
-    load_state_ = !abort_ ? LoadState::Loaded : LoadState::Failed;
-    if (on_load_finished_) {
-      on_load_finished_(seg_num, !abort_);
+size_t Segment::memoryUsage() {
+  size_t bytes = sizeof(Segment);
+  if (getState() == LoadState::Loaded) {
+    bytes += log->memoryUsage();
+  }
+  for (auto cam : ALL_CAMERAS) {
+    if (auto fr = frameReader(cam)) {
+      bytes += fr->memoryUsage();
     }
   }
+  return bytes;
 }
 
 Segment::LoadState Segment::getState() {
@@ -1,11 +1,17 @@
 #include "seg_mgr.h"
 
 #include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "common/timing.h"
 
 SegmentManager::SegmentManager(const ReplayConfig& cfg)
-    : flags_(cfg.flags), route_(cfg.route, cfg.data_dir, cfg.auto_source) {
+    : flags_(cfg.flags), route_(cfg.route, cfg.data_dir, cfg.auto_source), playback_speed_(cfg.playback_speed),
+      warm_cache_memory_(cfg.warm_cache_memory) {
   event_data_ = std::make_shared<EventData>();
   setSegmentCacheLimit(cfg.cache_segments);
+  setCacheMemoryLimit(cfg.cache_memory, cfg.mem_reserve);
 }
 
 SegmentManager::~SegmentManager() {
@@ -44,12 +50,29 @@ void SegmentManager::setCurrentSegment(int seg_num) {
     std::unique_lock lock(mutex_);
     if (cur_seg_num_ == seg_num) return;
 
+    // Playback advances one segment at a time, anything else is a seek
+    if (cur_seg_num_ >= 0 && seg_num != cur_seg_num_ + 1) {
+      seek_bias_ = std::clamp(seek_bias_ + (seg_num > cur_seg_num_ ? 0.5f : -0.5f), -1.0f, 1.0f);
+    } else {
+      seek_bias_ *= 0.5f;
+    }
     cur_seg_num_ = seg_num;
     needs_update_ = true;
   }
   cv_.notify_one();
 }
 
+void SegmentManager::setPlaybackSpeed(float speed) {
+  {
+    std::unique_lock lock(mutex_);
+    if (playback_speed_ == speed) return;
+
+    playback_speed_ = speed;
+    needs_update_ = true;
+  }
+  cv_.notify_one();
+}
+
 void SegmentManager::manageSegmentCache() {
   while (true) {
     std::unique_lock lock(mutex_);
@@ -60,61 +83,197 @@ void SegmentManager::manageSegmentCache() {
     auto cur = segments_.lower_bound(cur_seg_num_);
     if (cur == segments_.end()) continue;
 
-    // Calculate the range of segments to load
-    auto begin = std::prev(cur, std::min<int>(segment_cache_limit_ / 2, std::distance(segments_.begin(), cur)));
-    auto end = std::next(begin, std::min<int>(segment_cache_limit_, std::distance(begin, segments_.end())));
-    begin = std::prev(end, std::min<int>(segment_cache_limit_, std::distance(segments_.begin(), end)));
-
+    const float ahead_ratio = aheadRatio();
+    auto callback = onSegmentMergedCallback_;
     lock.unlock();
 
+    auto [begin, end] = cacheWindow(cur, ahead_ratio);
+
     loadSegmentsInRange(begin, cur, end);
     bool merged = mergeSegments(begin, end);
 
     // Free segments outside the current range
-    std::for_each(segments_.begin(), begin, [](auto &segment) { segment.second.reset(); });
-    std::for_each(end, segments_.end(), [](auto &segment) { segment.second.reset(); });
+    std::for_each(segments_.begin(), begin, [this](auto &segment) { evictSegment(segment.second); });
+    std::for_each(end, segments_.end(), [this](auto &segment) { evictSegment(segment.second); });
+
+    if (merged && callback && !exit_) {
+      callback();  // Notify listener that segments have been merged
+    }
+  }
+}
+
+// Share of the window placed after the current segment. Centered at normal speed, leaning
+// forward as playback gets faster (up to 90% at 8x) and towards the recent seek direction.
+float SegmentManager::aheadRatio() const {
+  float ratio = 0.5f;
+  if (playback_speed_ > 1.0f) {
+    ratio += 0.4f * std::min(1.0f, std::log2(playback_speed_) / 3.0f);
+  }
+  return std::clamp(ratio + seek_bias_ * 0.25f, 0.1f, 0.9f);
+}
+
+std::pair<SegmentMap::iterator, SegmentMap::iterator> SegmentManager::cacheWindow(SegmentMap::iterator cur, float ahead_ratio) {
+  if (cache_memory_ > 0 || mem_reserve_ > 0) {
+    return memoryWindow(cur, ahead_ratio);
+  }
+
+  // Calculate the range of segments to load
+  const int ahead = std::lround((segment_cache_limit_ - 1) * ahead_ratio);
+  const int behind = segment_cache_limit_ - 1 - ahead;
+  auto begin = std::prev(cur, std::min<int>(behind, std::distance(segments_.begin(), cur)));
+  auto end = std::next(begin, std::min<int>(segment_cache_limit_, std::distance(begin, segments_.end())));
+  begin = std::prev(end, std::min<int>(segment_cache_limit_, std::distance(segments_.begin(), end)));
+  return {begin, end};
+}
+
+// Grow the window around the current segment until the budget is spent. Segments that
+// are not loaded yet are estimated from the average size of the ones that are. Without a
+// memory budget, the segment count limits the window and the reserve only shrinks it.
+std::pair<SegmentMap::iterator, SegmentMap::iterator> SegmentManager::memoryWindow(SegmentMap::iterator cur, float ahead_ratio) {
+  size_t usage = 0, measured = 0;
+  for (const auto &[n, segment] : segments_) {
+    if (segment && segment->getState() == Segment::LoadState::Loaded) {
+      usage += segment->memoryUsage();
+      ++measured;
+    }
+  }
+  // Evicted segments waiting for compression are still resident
+  const size_t compressing = warm_pending_memory_;
+  usage += compressing;
+  memory_usage_ = usage;
+
+  size_t budget = cache_memory_ > 0 ? cache_memory_.load() : std::numeric_limits<size_t>::max();
+  const int max_segments = cache_memory_ > 0 ? std::numeric_limits<int>::max() : segment_cache_limit_;
+  if (size_t available = mem_reserve_ > 0 ? memAvailable() : 0) {
+    // Memory already held by the cache is available to it as well
+    size_t limit = usage + (available > mem_reserve_ ? available - mem_reserve_ : 0);
+    if (limit < budget) {
+      rDebug("MemAvailable %s, shrinking segment cache to %s", formattedDataSize(available).c_str(),
+             formattedDataSize(limit).c_str());
+      budget = limit;
+    }
+  }
+  budget = budget > compressing ? budget - compressing : 0;
 
-    if (merged && onSegmentMergedCallback_ && !exit_) {
-      onSegmentMergedCallback_();  // Notify listener that segments have been merged
+  const size_t estimate = measured > 0 ? usage / measured : DEFAULT_SEGMENT_MEMORY_ESTIMATE;
+  auto segmentSize = [estimate](const SegmentMap::iterator &it) {
+    const auto &segment = it->second;
+    return segment && segment->getState() == Segment::LoadState::Loaded ? segment->memoryUsage() : estimate;
+  };
+
+  // The current segment is always kept, then grow on the side that is below its share
+  auto begin = cur, end = std::next(cur);
+  size_t total = segmentSize(cur);
+  int ahead = 0, behind = 0;
+  while ((begin != segments_.begin() || end != segments_.end()) && ahead + behind + 1 < max_segments) {
+    bool forward = ahead < ahead_ratio * (ahead + behind + 1);
+    if (forward ? end == segments_.end() : begin == segments_.begin()) {
+      forward = !forward;
     }
+    auto next = forward ? end : std::prev(begin);
+    size_t size = segmentSize(next);
+    if (total + size > budget) break;
+
+    total += size;
+    forward ? (++end, ++ahead) : (--begin, ++behind);
+  }
+
+  rDebug("segment cache: %d segments, %s in use, %s budget", (int)std::distance(begin, end),
+         formattedDataSize(usage).c_str(), formattedDataSize(budget).c_str());
+  return {begin, end};
+}
+
+void SegmentManager::evictSegment(std::shared_ptr<Segment> &segment) {
+  if (!segment) return;
+
+  if (warm_cache_memory_ > 0 && segment->getState() == Segment::LoadState::Loaded) {
+    bool cached = false;
+    {
+      std::lock_guard lock(warm_mutex_);
+      auto it = std::find_if(warm_logs_.begin(), warm_logs_.end(), [n = segment->seg_num](auto &w) { return w.first == n; });
+      if ((cached = it != warm_logs_.end())) {
+        warm_logs_.splice(warm_logs_.end(), warm_logs_, it);
+      }
+    }
+    if (!cached) {
+      // The task keeps the segment alive until its log is compressed, the cache window counts
+      // it until then
+      const size_t size = segment->memoryUsage();
+      warm_pending_memory_ += size;
+      warm_tasks_.submit([this, seg = segment, size]() {
+        if (auto log = seg->log->compress(warm_tasks_.cancelFlag())) {
+          rDebug("segment %d compressed into warm cache: %s -> %s", seg->seg_num,
+                 formattedDataSize(log->raw_size).c_str(), formattedDataSize(log->data.size()).c_str());
+          addWarmLog(seg->seg_num, std::move(log));
+        }
+        warm_pending_memory_ -= size;
+      }, TaskPriority::Low);
+    }
+  }
+  segment.reset();
+}
+
+void SegmentManager::addWarmLog(int seg_num, std::shared_ptr<const CompressedLog> log) {
+  std::lock_guard lock(warm_mutex_);
+  // A segment evicted again while its first compression was queued is compressed twice
+  auto it = std::find_if(warm_logs_.begin(), warm_logs_.end(), [seg_num](auto &w) { return w.first == seg_num; });
+  if (it != warm_logs_.end()) {
+    warm_usage_ -= it->second->memoryUsage();
+    warm_logs_.erase(it);
   }
+  warm_usage_ += log->memoryUsage();
+  warm_logs_.emplace_back(seg_num, std::move(log));
+  while (warm_usage_ > warm_cache_memory_ && !warm_logs_.empty()) {
+    warm_usage_ -= warm_logs_.front().second->memoryUsage();
+    warm_logs_.pop_front();
+  }
+}
+
+// The entry stays in the warm tier, so that evicting the segment again is free
+std::shared_ptr<const CompressedLog> SegmentManager::warmLog(int seg_num) {
+  std::lock_guard lock(warm_mutex_);
+  auto it = std::find_if(warm_logs_.begin(), warm_logs_.end(), [seg_num](auto &w) { return w.first == seg_num; });
+  if (it == warm_logs_.end()) return nullptr;
+
+  warm_logs_.splice(warm_logs_.end(), warm_logs_, it);
+  return it->second;
+}
+
+size_t SegmentManager::warmMemoryUsage() {
+  std::lock_guard lock(warm_mutex_);
+  return warm_usage_;
 }
 
 bool SegmentManager::mergeSegments(const SegmentMap::iterator &begin, const SegmentMap::iterator &end) {
   std::set<int> segments_to_merge;
-  size_t total_event_count = 0;
   for (auto it = begin; it != end; ++it) {
     const auto &segment = it->second;
     if (segment && segment->getState() == Segment::LoadState::Loaded) {
       segments_to_merge.insert(segment->seg_num);
-      total_event_count += segment->log->events.size();
     }
   }
 
   if (segments_to_merge == merged_segments_) return false;
 
-  auto merged_event_data = std::make_shared<EventData>();
-  auto &merged_events = merged_event_data->events;
-  merged_events.reserve(total_event_count);
-
   std::string segments_str = join(segments_to_merge, ", ");
   rDebug("merging segments: %s", segments_str.c_str());
-  for (int n : segments_to_merge) {
-    if (exit_) return false;
-
-    const auto &events = segments_.at(n)->log->events;
-    if (events.empty()) continue;
-
-    // Skip INIT_DATA if present
-    auto events_begin = (events.front().which == cereal::Event::Which::INIT_DATA) ? std::next(events.begin()) : events.begin();
-
-    size_t previous_size = merged_events.size();
-    merged_events.insert(merged_events.end(), events_begin, events.end());
-    std::inplace_merge(merged_events.begin(), merged_events.begin() + previous_size, merged_events.end());
 
-    merged_event_data->segments[n] = segments_.at(n);
+  // Segment events are sorted and immutable once loaded, so merging only references them
+  const double start_ts = millis_since_boot();
+  auto merged_event_data = std::make_shared<EventData>();
+  for (int n : segments_to_merge) {
+    const auto &segment = segments_.at(n);
+    const auto &events = segment->log->events;
+    if (!events.empty()) {
+      // Skip INIT_DATA if present
+      const Event *first = events.data() + (events.front().which == cereal::Event::Which::INIT_DATA ? 1 : 0);
+      merged_event_data->events.addChunk(n, first, events.data() + events.size());
+    }
+    merged_event_data->segments[n] = segment;
   }
 
+  merged_event_data->merge_ms = millis_since_boot() - start_ts;
+  merged_event_data->merged_ts = nanos_since_boot();
   std::atomic_store(&event_data_, std::move(merged_event_data));
   merged_segments_ = segments_to_merge;
 
@@ -122,7 +281,7 @@ bool SegmentManager::mergeSegments(const SegmentMap::iterator &begin, const Segm
 }
 
 void SegmentManager::loadSegmentsInRange(SegmentMap::iterator begin, SegmentMap::iterator cur, SegmentMap::iterator end) {
-  auto tryLoadSegment = [this](auto first, auto last) {
+  auto tryLoadSegment = [this, cur_seg_num = cur->first](auto first, auto last) {
     for (auto it = first; it != last; ++it) {
       if (exit_) return true;
 
@@ -134,7 +293,8 @@ void SegmentManager::loadSegmentsInRange(SegmentMap::iterator begin, SegmentMap:
               std::unique_lock lock(mutex_);
               needs_update_ = true;
               cv_.notify_one();
-            });
+            },
+            it->first == cur_seg_num ? TaskPriority::High : TaskPriority::Normal, warmLog(it->first));
       }
 
       if (segment_ptr->getState() == Segment::LoadState::Loading) {
@@ -0,0 +1,122 @@
+#include "stream_timer.h"
+
+#include <algorithm>
+#include <chrono>
+
+#ifndef __APPLE__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#endif
+
+#include "common/timing.h"
+#include "util.h"
+
+// The condition variable fallback
+bool StreamTimer::waitUntil(uint64_t deadline_ns) {
+  const int64_t timeout_ns = (int64_t)(deadline_ns - nanos_monotonic());
+  std::unique_lock lock(mutex_);
+  bool woken = cv_.wait_for(lock, std::chrono::nanoseconds(std::max<int64_t>(timeout_ns, 0)), [this]() { return woken_; });
+  woken_ = false;
+  return !woken;
+}
+
+void StreamTimer::notify() {
+  {
+    std::lock_guard lock(mutex_);
+    woken_ = true;
+  }
+  cv_.notify_one();
+}
+
+#ifdef __APPLE__
+
+StreamTimer::StreamTimer() {}
+StreamTimer::~StreamTimer() {}
+
+bool StreamTimer::sleepUntil(uint64_t deadline_ns) {
+  return waitUntil(deadline_ns);
+}
+
+void StreamTimer::wake() {
+  notify();
+}
+
+#else
+
+StreamTimer::StreamTimer() {
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+  bool ok = epoll_fd_ >= 0 && timer_fd_ >= 0 && event_fd_ >= 0;
+  for (int fd : {timer_fd_, event_fd_}) {
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    ok = ok && epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) == 0;
+  }
+
+  if (!ok) {
+    rWarning("stream timer: failed to set up epoll (%s), falling back to a condition variable", strerror(errno));
+    for (int *fd : {&event_fd_, &timer_fd_, &epoll_fd_}) {
+      if (*fd >= 0) close(*fd);
+      *fd = -1;
+    }
+  }
+}
+
+StreamTimer::~StreamTimer() {
+  if (epoll_fd_ >= 0) {
+    close(event_fd_);
+    close(timer_fd_);
+    close(epoll_fd_);
+  }
+}
+
+bool StreamTimer::sleepUntil(uint64_t deadline_ns) {
+  if (epoll_fd_ < 0) return waitUntil(deadline_ns);
+
+  struct itimerspec spec = {};
+  spec.it_value.tv_sec = deadline_ns / 1000000000;
+  spec.it_value.tv_nsec = deadline_ns % 1000000000;
+  if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) return true;  // zero would disarm the timer
+  timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &spec, nullptr);
+
+  while (true) {
+    struct epoll_event events[2];
+    int n = epoll_wait(epoll_fd_, events, 2, -1);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return true;
+    }
+
+    bool expired = false, woken = false;
+    uint64_t count;
+    for (int i = 0; i < n; ++i) {
+      if (events[i].data.fd == timer_fd_) {
+        expired = read(timer_fd_, &count, sizeof(count)) == sizeof(count);
+      } else {
+        woken = read(event_fd_, &count, sizeof(count)) == sizeof(count);
+      }
+    }
+    if (woken) return false;
+    if (expired) return true;
+  }
+}
+
+void StreamTimer::wake() {
+  if (epoll_fd_ < 0) {
+    notify();
+    return;
+  }
+
+  uint64_t one = 1;
+  [[maybe_unused]] ssize_t ret = write(event_fd_, &one, sizeof(one));
+}
+
+#endif
@@ -7,15 +7,17 @@
 #include "cereal/gen/cpp/log.capnp.h"
 
 Timeline::~Timeline() {
-  should_exit_.store(true);
-  if (thread_.joinable()) {
-    thread_.join();
-  }
+  tasks_.cancel();
+  tasks_.wait();
 }
 
 void Timeline::initialize(const Route &route, uint64_t route_start_ts, bool local_cache,
                           std::function<void(std::shared_ptr<LogReader>)> callback) {
-  thread_ = std::thread(&Timeline::buildTimeline, this, route, route_start_ts, local_cache, callback);
+  segments_ = route.segments();
+  route_start_ts_ = route_start_ts;
+  local_cache_ = local_cache;
+  callback_ = callback;
+  tasks_.submit([this]() { buildTimeline(segments_.cbegin()); }, TaskPriority::Low);
 }
 
 std::optional<uint64_t> Timeline::find(double cur_ts, FindFlag flag) const {
@@ -48,9 +50,8 @@ std::optional<Timeline::Entry> Timeline::findAlertAtTime(double target_time) con
   return std::nullopt;
 }
 
-void Timeline::buildTimeline(const Route &route, uint64_t route_start_ts, bool local_cache,
-                             std::function<void(std::shared_ptr<LogReader>)> callback) {
-  std::optional<size_t> current_engaged_idx, current_alert_idx;
+void Timeline::buildTimeline(std::map<int, SegmentFile>::const_iterator it) {
+  if (it == segments_.cend() || tasks_.cancelled()) return;
 
   auto event_schema = capnp::Schema::from<cereal::Event>().asStruct();
   std::vector<bool> filters = std::vector<bool>(event_schema.getUnionFields().size(), false);
@@ -59,21 +60,15 @@ void Timeline::buildTimeline(const Route &route, uint64_t route_start_ts, bool l
   filters[cereal::Event::Which::USER_BOOKMARK] = true;
   filters[cereal::Event::Which::THUMBNAIL] = true;
 
-  for (const auto &segment : route.segments()) {
-    if (should_exit_) break;
-
-    auto log = std::make_shared<LogReader>(filters);
-    if (!log->load(segment.second.qlog, false, &should_exit_, local_cache, 0, 3) || log->events.empty()) {
-      continue;  // Skip if log loading fails or no events
-    }
-
+  auto log = std::make_shared<LogReader>(filters);
+  if (log->load(it->second.qlog, false, tasks_.cancelFlag(), local_cache_, 0, 3) && !log->events.empty()) {
     for (const Event &e : log->events) {
-      double seconds = (e.mono_time - route_start_ts) / 1e9;
+      double seconds = (e.mono_time - route_start_ts_) / 1e9;
       if (e.which == cereal::Event::Which::SELFDRIVE_STATE) {
         capnp::FlatArrayMessageReader reader(e.data);
         auto cs = reader.getRoot<cereal::Event>().getSelfdriveState();
-        updateEngagementStatus(cs, current_engaged_idx, seconds);
-        updateAlertStatus(cs, current_alert_idx, seconds);
+        updateEngagementStatus(cs, current_engaged_idx_, seconds);
+        updateAlertStatus(cs, current_alert_idx_, seconds);
       } else if (e.which == cereal::Event::Which::USER_BOOKMARK) {
         staging_entries_.emplace_back(Entry{seconds, seconds, TimelineType::UserBookmark});
       }
@@ -84,8 +79,10 @@ void Timeline::buildTimeline(const Route &route, uint64_t route_start_ts, bool l
     std::sort(entries->begin(), entries->end(), [](auto &a, auto &b) { return a.start_time < b.start_time; });
     std::atomic_store(&timeline_entries_, std::move(entries));
 
-    callback(log);  // Notify the callback once the log is processed
+    callback_(log);  // Notify the callback once the log is processed
   }
+
+  tasks_.submit([this, next = std::next(it)]() { buildTimeline(next); }, TaskPriority::Low);
 }
 
 void Timeline::updateEngagementStatus(const cereal::SelfdriveState::Reader &cs, std::optional<size_t> &idx, double seconds) {
@@ -8,7 +8,9 @@
 #include <cmath>
 #include <cstdarg>
 #include <cstring>
+#include <fstream>
 #include <iostream>
+#include <limits>
 #include <map>
 #include <mutex>
 #include <utility>
@@ -46,25 +48,6 @@ void logMessage(ReplyMsgType type, const char *fmt, ...) {
   }
 }
 
-void precise_nano_sleep(int64_t nanoseconds, std::atomic<bool> &interrupt_requested) {
-  struct timespec req, rem;
-  req.tv_sec = nanoseconds / 1000000000;
-  req.tv_nsec = nanoseconds % 1000000000;
-  while (!interrupt_requested) {
-#ifdef __APPLE__
-    int ret = nanosleep(&req, &rem);
-    if (ret == 0 || errno != EINTR)
-      break;
-#else
-    int ret = clock_nanosleep(CLOCK_MONOTONIC, 0, &req, &rem);
-    if (ret == 0 || ret != EINTR)
-      break;
-#endif
-    // Retry sleep if interrupted by a signal
-    req = rem;
-  }
-}
-
 std::string sha256(const std::string &str) {
   unsigned char hash[SHA256_DIGEST_LENGTH];
   EVP_MD_CTX *mdctx = EVP_MD_CTX_new();
@@ -93,6 +76,21 @@ std::vector<std::string> split(std::string_view source, char delimiter) {
   return fields;
 }
 
+size_t memAvailable() {
+#ifdef __APPLE__
+  return 0;
+#else
+  std::ifstream meminfo("/proc/meminfo");
+  std::string key;
+  size_t value_kb = 0;
+  while (meminfo >> key >> value_kb) {
+    if (key == "MemAvailable:") return value_kb * 1024;
+    meminfo.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+  }
+  return 0;
+#endif
+}
+
 std::string extractFileName(const std::string &file) {
   size_t queryPos = file.find_first_of("?");
   std::string path = (queryPos != std::string::npos) ? file.substr(0, queryPos) : file;
@@ -108,6 +106,7 @@ void *MonotonicBuffer::allocate(size_t bytes, size_t alignment) {
   if (p == nullptr) {
     available = next_buffer_size = std::max(next_buffer_size, bytes);
     current_buf = buffers.emplace_back(std::aligned_alloc(alignment, next_buffer_size));
+    allocated_size += next_buffer_size;
     next_buffer_size *= growth_factor;
     p = current_buf;
   }